@@ -1,6 +1,15 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
+#include <format>
 #include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #define B_LDR_IMPLEMENTATION
 #define BLD_USE_CONFIG
@@ -152,6 +161,195 @@ void build_static()
   bld::log(bld::Log_type::INFO, "Static executable built: " + BUILD_FOLDER + EXECUTABLE + "_static");
 }
 
+struct Bench_case
+{
+  std::string name;
+  std::vector<std::string> args;
+  bool cold;  // Drop the data snapshot before every run, so each one rebuilds it from data.json
+};
+
+// Runs the command once with all its output discarded, returns the wall time in microseconds or -1 on failure
+double time_run(const std::vector<std::string> &args)
+{
+  std::vector<char *> argv;
+  for (const auto &arg : args)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    int null_fd = open("/dev/null", O_RDWR);
+    dup2(null_fd, STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+  if (pid < 0)
+    return -1;
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return -1;
+  return (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+// Syscalls made by one run (children included), from `strace -c`; -1 when strace isn't available
+long count_syscalls(const std::vector<std::string> &args, const std::string &out_file)
+{
+  std::vector<std::string> traced = {"strace", "-f", "-c", "-o", out_file};
+  traced.insert(traced.end(), args.begin(), args.end());
+  if (time_run(traced) < 0)
+    return -1;
+
+  // Last line of the summary: "100.00 <seconds> <usecs/call> <calls> [errors] total"
+  std::vector<std::string> lines;
+  if (!bld::fs::read_lines(out_file, lines))
+    return -1;
+  for (auto it = lines.rbegin(); it != lines.rend(); ++it)
+  {
+    if (it->find("total") == std::string::npos)
+      continue;
+    std::vector<std::string> fields;
+    for (const auto &field : bld::str::chop_by_delimiter(*it, " "))
+      if (!field.empty())
+        fields.push_back(field);
+    return fields.size() >= 5 ? std::atol(fields[3].c_str()) : -1;
+  }
+  return -1;
+}
+
+// Writes a config and a data set of `files` files (with as many aliases) under dir
+bool write_bench_data(const std::string &dir, int files)
+{
+  std::string shown = std::filesystem::absolute(dir + "shown.txt").string();
+  std::string text;
+  for (int i = 0; i < 200; ++i)
+    text += std::format("line {} of the file shown by the benchmark\n", i);
+
+  std::string data = "{\"files\":[";
+  for (int i = 0; i < files; ++i)
+    data += std::format("{}{{\"name\":\"file{}.txt\",\"path\":\"{}\"}}", i ? "," : "", i, shown);
+  data += "],\"aliases\":[";
+  for (int i = 0; i < files; ++i)
+    data += std::format("{}{{\"alias\":\"a{}\",\"file\":\"file{}.txt\"}}", i ? "," : "", i, i);
+  data += "],\"todos\":[";
+  for (int i = 0; i < 20; ++i)
+    data += std::format("{}{{\"done\":false,\"due-date\":\"01/01/2030\",\"todo\":\"todo {}\"}}", i ? "," : "", i);
+  data += "]}\n";
+
+  std::filesystem::remove(dir + "data/meow/data.log");
+  std::filesystem::remove(dir + "data/meow/data.snap");
+  return bld::fs::create_dirs_if_not_exists(dir + "config/meow", dir + "data/meow", dir + "run") &&
+         bld::fs::write_entire_file(dir + "shown.txt", text) &&
+         bld::fs::write_entire_file(dir + "config/meow/config.json", "{\"backend\":\"cat\"}\n") &&
+         bld::fs::write_entire_file(dir + "data/meow/data.json", data);
+}
+
+int env_or(const char *name, int fallback)
+{
+  const char *value = std::getenv(name);
+  return value && std::atoi(value) > 0 ? std::atoi(value) : fallback;
+}
+
+// bench-startup: times typical commands of the optimized build against a generated data set.
+// BLD_BENCH_RUNS (default 200) runs per command, BLD_BENCH_FILES (default 1000) files in the data set.
+void handle_bench_startup()
+{
+  build_static();
+
+  const std::string exe = std::filesystem::absolute(BUILD_FOLDER + EXECUTABLE + "_static").string();
+  const std::string dir = BUILD_FOLDER + "bench/";
+  const int runs = env_or("BLD_BENCH_RUNS", 200);
+  const int files = env_or("BLD_BENCH_FILES", 1000);
+  const double target_us = 1000;
+
+  if (!write_bench_data(dir, files))
+  {
+    bld::log(bld::Log_type::ERR, "Failed to write the benchmark data.");
+    exit(1);
+  }
+
+  // Everything meow looks at lives under the bench directory, so no user data and no running daemon is touched
+  const std::string abs_dir = std::filesystem::absolute(dir).string();
+  setenv("XDG_CONFIG_HOME", (abs_dir + "config").c_str(), 1);
+  setenv("XDG_DATA_HOME", (abs_dir + "data").c_str(), 1);
+  setenv("XDG_RUNTIME_DIR", (abs_dir + "run").c_str(), 1);
+  unsetenv("MEOW_NO_DAEMON");
+
+  std::string strace_path;
+  const bool have_strace = bld::read_shell_output("command -v strace || true", strace_path) && !bld::str::trim(strace_path).empty();
+
+  const std::vector<Bench_case> cases = {
+    {"help",               {exe, "help"},               false},
+    {"list (warm)",        {exe, "list"},               false},
+    {"list (cold)",        {exe, "list"},               true},
+    {"show alias (warm)",  {exe, "show", "a1"},         false},
+    {"show alias (cold)",  {exe, "show", "a1"},         true},
+    {"todo list (warm)",   {exe, "todo", "list"},       false},
+  };
+
+  bld::log(bld::Log_type::INFO, std::format("Benchmarking {} ({} runs each, {} files, cat backend)", exe, runs, files));
+  bool all_under_target = true;
+
+  for (const auto &c : cases)
+  {
+    const std::string snapshot = dir + "data/meow/data.snap";
+    std::vector<double> times;
+    bool failed = false;
+
+    // Warm runs start from a built snapshot and a hot page cache
+    for (int i = 0; i < (c.cold ? 1 : 5) && !failed; ++i)
+      failed = time_run(c.args) < 0;
+
+    for (int i = 0; i < runs && !failed; ++i)
+    {
+      if (c.cold)
+        std::filesystem::remove(snapshot);
+      double us = time_run(c.args);
+      failed = us < 0;
+      times.push_back(us);
+    }
+    if (failed)
+    {
+      bld::log(bld::Log_type::ERR, std::format("{}: command failed", c.name));
+      exit(1);
+    }
+
+    std::sort(times.begin(), times.end());
+    double mean = 0;
+    for (double t : times)
+      mean += t;
+    mean /= times.size();
+    double variance = 0;
+    for (double t : times)
+      variance += (t - mean) * (t - mean);
+    double stddev = std::sqrt(variance / times.size());
+    double median = times[times.size() / 2];
+
+    if (c.cold)
+      std::filesystem::remove(snapshot);
+    long syscalls = have_strace ? count_syscalls(c.args, dir + "strace.txt") : -1;
+
+    all_under_target = all_under_target && median < target_us;
+    bld::log(bld::Log_type::INFO,
+             std::format("{:<20} median {:8.1f} us  mean {:8.1f} ± {:6.1f}  min {:8.1f}  max {:8.1f}  syscalls {:>5}  {}", c.name,
+                         median, mean, stddev, times.front(), times.back(), syscalls < 0 ? "n/a" : std::to_string(syscalls),
+                         median < target_us ? "ok" : "over 1ms"));
+  }
+
+  if (!have_strace)
+    bld::log(bld::Log_type::WARNING, "strace not found, syscall counts skipped.");
+  exit(all_under_target ? 0 : 2);
+}
+
 void handle_install()
 {
   // Build the path for the static executable
@@ -221,6 +419,11 @@ int main(int argc, char **argv)
         handle_install();
         return 0;
       }
+      else if (args[0] == "bench-startup")
+      {
+        handle_bench_startup();
+        return 0;
+      }
 
       bld::log(bld::Log_type::ERR, "Only 'run' and 'clean' commands are supported.");
       return 1;
@@ -228,7 +431,7 @@ int main(int argc, char **argv)
     else if (args.size() > 1)
     {
       bld::log(bld::Log_type::ERR, "Invalid argument count.\n");
-      bld::log(bld::Log_type::ERR, "Only 'run', 'clean', 'static' & 'install' commands are supported.");
+      bld::log(bld::Log_type::ERR, "Only 'run', 'clean', 'static', 'install' & 'bench-startup' commands are supported.");
       return 1;
     }
   }
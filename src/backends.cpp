@@ -0,0 +1,206 @@
+#include "./backends.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./paths.hpp"
+#include "./utils.hpp"
+
+namespace meow::backends
+{
+  // One line per backend: "<name>\t<path>\t<stamp>", path empty when it wasn't found. The first line holds the hash
+  // of the $PATH the entries were resolved against.
+  struct entry
+  {
+    std::string name;
+    std::string path;
+    std::uint64_t stamp = 0;
+  };
+
+  static std::uint64_t fnv1a(std::uint64_t h, std::string_view bytes)
+  {
+    for (char c : bytes)
+      h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return h;
+  }
+
+  static constexpr std::uint64_t FNV_BASIS = 14695981039346656037ull;
+
+  static std::uint64_t mtime_ns(const struct stat &st)
+  {
+    return static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1'000'000'000ull + static_cast<std::uint64_t>(st.st_mtim.tv_nsec);
+  }
+
+  static std::vector<std::string_view> path_dirs(std::string_view path_env)
+  {
+    std::vector<std::string_view> dirs;
+    while (true)
+    {
+      std::size_t colon = path_env.find(':');
+      std::string_view dir = path_env.substr(0, colon);
+      dirs.push_back(dir.empty() ? "." : dir);
+      if (colon == std::string_view::npos)
+        break;
+      path_env.remove_prefix(colon + 1);
+    }
+    return dirs;
+  }
+
+  // Changes whenever a file is added to or removed from one of the directories
+  static std::uint64_t dirs_stamp(std::span<const std::string_view> dirs)
+  {
+    std::uint64_t h = FNV_BASIS;
+    for (std::string_view dir : dirs)
+    {
+      struct stat st{};
+      if (::stat(std::string(dir).c_str(), &st) == 0)
+        h = fnv1a(h, std::format("{}:{}:{};", st.st_ino, mtime_ns(st), dir));
+    }
+    return h;
+  }
+
+  // What a relative directory ("." or an empty entry) holds depends on where meow runs from
+  static bool is_relative(std::string_view dir) { return !dir.starts_with('/'); }
+
+  static std::string candidate(std::string_view dir, std::string_view name)
+  {
+    return std::filesystem::path(std::format("{}/{}", dir, name)).lexically_normal().string();
+  }
+
+  // The mtime of an executable, 0 when it's gone or no longer executable
+  static std::uint64_t binary_stamp(const std::string &path)
+  {
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || ::access(path.c_str(), X_OK) != 0)
+      return 0;
+    return mtime_ns(st);
+  }
+
+  // A found backend stays valid while it keeps its mtime and none of the directories searched before its own gains or
+  // loses a file, which is when execvp could start picking another one
+  static std::uint64_t found_stamp(const std::string &path, std::span<const std::string_view> earlier)
+  {
+    const std::uint64_t binary = binary_stamp(path);
+    return binary == 0 ? 0 : fnv1a(dirs_stamp(earlier), std::format("{}", binary));
+  }
+
+  // What execvp would pick: the index of the first $PATH directory with a regular, executable file named `name`
+  static std::optional<std::size_t> search(std::string_view name, std::span<const std::string_view> dirs)
+  {
+    for (std::size_t i = 0; i < dirs.size(); ++i)
+      if (binary_stamp(candidate(dirs[i], name)) != 0)
+        return i;
+    return std::nullopt;
+  }
+
+  static std::string cache_path() { return paths::cache_dir() + "/backends"; }
+
+  static std::vector<entry> load(std::uint64_t path_hash)
+  {
+    std::vector<entry> entries;
+    auto text = meow::read_file(cache_path());
+    if (!text)
+      return entries;
+
+    std::string_view rest = *text;
+    bool header = true;
+    while (!rest.empty())
+    {
+      std::size_t nl = rest.find('\n');
+      std::string_view line = rest.substr(0, nl);
+      rest = nl == std::string_view::npos ? std::string_view{} : rest.substr(nl + 1);
+
+      if (header)
+      {
+        // Entries resolved against another $PATH are useless
+        if (line != std::format("path {}", path_hash))
+          return entries;
+        header = false;
+        continue;
+      }
+
+      std::size_t tab1 = line.find('\t');
+      std::size_t tab2 = tab1 == std::string_view::npos ? tab1 : line.find('\t', tab1 + 1);
+      if (tab2 == std::string_view::npos)
+        continue;
+      entries.push_back({std::string(line.substr(0, tab1)), std::string(line.substr(tab1 + 1, tab2 - tab1 - 1)),
+                         std::strtoull(std::string(line.substr(tab2 + 1)).c_str(), nullptr, 10)});
+    }
+    return entries;
+  }
+
+  // Best effort: without a cache every run just searches $PATH again
+  static void store(std::uint64_t path_hash, const std::vector<entry> &entries)
+  {
+    std::string text = std::format("path {}\n", path_hash);
+    for (const auto &e : entries)
+      text += std::format("{}\t{}\t{}\n", e.name, e.path, e.stamp);
+
+    std::error_code ec;
+    std::filesystem::create_directories(paths::cache_dir(), ec);
+    if (!ec)
+      (void)meow::write_file(cache_path(), text);
+  }
+
+  std::optional<std::string> resolve(std::string_view name)
+  {
+    if (name.empty())
+      return std::nullopt;
+
+    // A path is used as is, only $PATH lookups are worth remembering
+    if (name.find('/') != std::string_view::npos)
+    {
+      std::string path(name);
+      return binary_stamp(path) != 0 ? std::optional(path) : std::nullopt;
+    }
+
+    const char *path_var = std::getenv("PATH");
+    const std::string_view path_env = path_var ? path_var : "/usr/local/bin:/bin:/usr/bin";
+    const std::uint64_t path_hash = fnv1a(FNV_BASIS, path_env);
+    const std::vector<std::string_view> dirs = path_dirs(path_env);
+
+    std::vector<entry> entries = load(path_hash);
+    auto cached = std::ranges::find(entries, name, &entry::name);
+    if (cached != entries.end())
+    {
+      if (cached->path.empty() && dirs_stamp(dirs) == cached->stamp)
+        return std::nullopt;
+      for (std::size_t i = 0; !cached->path.empty() && i < dirs.size(); ++i)
+        if (candidate(dirs[i], name) == cached->path)
+        {
+          if (found_stamp(cached->path, std::span(dirs).first(i)) == cached->stamp)
+            return cached->path;
+          break;
+        }
+    }
+
+    const auto found = search(name, dirs);
+    const auto searched = std::span(dirs).first(found ? *found + 1 : dirs.size());
+    std::optional<std::string> path;
+    if (found)
+      path = std::filesystem::absolute(candidate(dirs[*found], name)).lexically_normal().string();
+
+    // Only lookups that didn't go through a relative directory give the same answer from anywhere
+    if (std::ranges::none_of(searched, is_relative))
+    {
+      entry fresh{std::string(name), path.value_or(""), path ? found_stamp(*path, searched.first(*found)) : dirs_stamp(dirs)};
+      if (cached != entries.end())
+        *cached = std::move(fresh);
+      else
+        entries.push_back(std::move(fresh));
+      store(path_hash, entries);
+    }
+
+    return path;
+  }
+}  // namespace meow::backends
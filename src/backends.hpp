@@ -0,0 +1,21 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+/* Backend executables
+ *
+ * NOTE: The programs `show` and `open` hand files to (bat, cat, $EDITOR) are looked up on $PATH once and remembered in
+ *  $XDG_CACHE_HOME/meow/backends, so later runs spawn them by absolute path instead of walking $PATH in the child.
+ *  A remembered path is reused while $PATH is unchanged, the binary still has the same mtime and none of the $PATH
+ *  directories before its own changed (a binary of the same name installed earlier on $PATH wins, as with execvp). A
+ *  backend that wasn't found is remembered too, until $PATH or one of its directories changes. Lookups that go through
+ *  a relative $PATH entry ("." or an empty one) depend on the current directory and aren't remembered.
+ */
+
+namespace meow::backends
+{
+  // Absolute path of the executable `name` resolves to, nothing when it isn't installed
+  [[nodiscard]] std::optional<std::string> resolve(std::string_view name);
+}  // namespace meow::backends
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Command tables
+ *
+ * NOTE: Every (sub)command is described once: its name, an optional alias, its handler and the text `help` prints
+ *  for it. The table is built at compile time together with a perfect hash over all names and aliases (a seed is
+ *  searched until no two of them land in the same slot), so looking a command up is one hash and one compare and
+ *  adding a command with a clashing name just makes the compiler pick another seed.
+ */
+
+namespace meow
+{
+  using command_handler = void (*)(const std::vector<std::string> &args);
+
+  struct command
+  {
+    std::string_view name;
+    command_handler run;
+    std::string_view args = {};     // shown after the name in help, e.g. "<file|alias>"
+    std::string_view help = {};     // commands without help text are left out of it
+    std::string_view alias = {};
+    std::string_view section = {};  // help starts a new section whenever this changes
+  };
+
+  template <std::size_t N>
+  class command_table
+  {
+  private:
+    static constexpr std::size_t SLOTS = std::bit_ceil(N * 4);
+
+    std::array<command, N> commands{};
+    std::array<std::uint8_t, SLOTS> slots{};  // index into commands + 1, 0 for an empty slot
+    std::uint32_t seed = 0;
+
+    // FNV-1a, starting from the seed
+    static constexpr std::uint32_t hash(std::string_view name, std::uint32_t seed) noexcept
+    {
+      std::uint32_t h = 2166136261u ^ seed;
+      for (char c : name)
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+      return h ^ (h >> 15);
+    }
+
+    consteval bool try_seed(std::uint32_t candidate)
+    {
+      slots = {};
+      for (std::size_t i = 0; i < N; ++i)
+      {
+        for (std::string_view name : {commands[i].name, commands[i].alias})
+        {
+          if (name.empty())
+            continue;
+          auto &slot = slots[hash(name, candidate) & (SLOTS - 1)];
+          if (slot != 0)
+            return false;
+          slot = static_cast<std::uint8_t>(i + 1);
+        }
+      }
+      seed = candidate;
+      return true;
+    }
+
+  public:
+    consteval explicit command_table(const command (&list)[N])
+    {
+      static_assert(N < 255, "command tables index their slots with a byte");
+      for (std::size_t i = 0; i < N; ++i)
+        commands[i] = list[i];
+
+      for (std::uint32_t candidate = 0; candidate < 100000; ++candidate)
+        if (try_seed(candidate))
+          return;
+      throw "no perfect hash seed found, duplicate command name?";
+    }
+
+    [[nodiscard]] constexpr const command *find(std::string_view name) const noexcept
+    {
+      std::uint8_t slot = slots[hash(name, seed) & (SLOTS - 1)];
+      if (slot == 0)
+        return nullptr;
+
+      const command &cmd = commands[slot - 1];
+      return cmd.name == name || cmd.alias == name ? &cmd : nullptr;
+    }
+
+    [[nodiscard]] constexpr auto begin() const noexcept { return commands.begin(); }
+    [[nodiscard]] constexpr auto end() const noexcept { return commands.end(); }
+  };
+
+  // Prints the help lines of a table, `prefix` goes before every name (for subcommands)
+  template <std::size_t N>
+  void print_commands(const command_table<N> &table, std::string_view prefix = {})
+  {
+    std::string_view section;
+    for (const command &cmd : table)
+    {
+      if (cmd.help.empty())
+        continue;
+      if (cmd.section != section)
+      {
+        section = cmd.section;
+        std::println();
+        std::println("    --------------------{}--------------------", section);
+        std::println();
+      }
+
+      std::string label = std::format("{}{}", prefix, cmd.name);
+      if (!cmd.alias.empty())
+        label += std::format(", {}", cmd.alias);
+      if (!cmd.args.empty())
+        label += std::format(" {}", cmd.args);
+      std::println("     {:<30} {}", label, cmd.help);
+    }
+  }
+}  // namespace meow
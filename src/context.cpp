@@ -0,0 +1,63 @@
+#include "./context.hpp"
+
+#include <format>
+
+#include "./daemon.hpp"
+#include "./journal.hpp"
+#include "./paths.hpp"
+#include "./utils.hpp"
+
+namespace meow
+{
+  context &context::get()
+  {
+    static context ctx;
+    return ctx;
+  }
+
+  const std::string &context::config_path()
+  {
+    if (!config_file)
+      config_file = paths::config_path();
+    return *config_file;
+  }
+
+  const std::string &context::data_path()
+  {
+    if (!data_file)
+      data_file = paths::data_path();
+    return *data_file;
+  }
+
+  const jsn::value &context::config()
+  {
+    if (parsed_config)
+      return *parsed_config;
+
+    if (const jsn::value *resident = daemon::resident_config(config_path()))
+      return *resident;
+
+    jsn::value config;
+    if (!get_json(config_path(), config))
+      handle_error(std::format("Failed to load {}", config_path()));
+    return parsed_config.emplace(std::move(config));
+  }
+
+  const snapshot &context::data()
+  {
+    // A batch changes the data between commands, so it is rebuilt every time
+    if (const data_batch *batch = data_batch::current())
+      return loaded_data.emplace(snapshot::from_data(batch->data()));
+
+    if (loaded_data)
+      return *loaded_data;
+
+    if (const snapshot *resident = daemon::resident_snapshot(data_path()))
+      return *resident;
+
+    auto data = snapshot::load(data_path());
+    if (!data)
+      handle_error(data.error());
+    return loaded_data.emplace(std::move(*data));
+  }
+}  // namespace meow
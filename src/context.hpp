@@ -0,0 +1,37 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "./json.hpp"
+#include "./snapshot.hpp"
+
+namespace meow
+{
+  // What commands need from the config and data files. Each is located and loaded at most once per process, and only
+  // when a handler first asks for it. Inside a daemon request the resident copies are used, inside a batch the data
+  // includes the batch's uncommitted changes.
+  class context
+  {
+  private:
+    std::optional<std::string> config_file;
+    std::optional<std::string> data_file;
+    std::optional<jsn::value> parsed_config;
+    std::optional<snapshot> loaded_data;
+
+    context() = default;
+
+  public:
+    context(const context &) = delete;
+    context &operator=(const context &) = delete;
+
+    [[nodiscard]] static context &get();
+
+    [[nodiscard]] const std::string &config_path();
+    [[nodiscard]] const std::string &data_path();
+
+    // Both report through handle_error when the file can't be loaded
+    [[nodiscard]] const jsn::value &config();
+    [[nodiscard]] const snapshot &data();
+  };
+}  // namespace meow
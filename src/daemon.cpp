@@ -0,0 +1,515 @@
+#include "./daemon.hpp"
+
+#include <array>
+#include <charconv>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <print>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "./meow.hpp"
+#include "./paths.hpp"
+#include "./utils.hpp"
+
+extern char **environ;
+
+namespace meow::daemon
+{
+  // A request is one datagram of NUL-terminated fields: MAGIC, cwd, argc, args..., envc, env...
+  // with the client's stdin/stdout/stderr attached. The reply is the exit status as an int.
+  static constexpr std::string_view MAGIC = "meow-request-1";
+  static constexpr std::size_t MAX_REQUEST = 256 * 1024;
+
+  struct request
+  {
+    std::string cwd;
+    std::vector<std::string> args;
+    std::vector<std::string> env;
+  };
+
+  struct resident_state
+  {
+    std::string config_path;
+    std::string data_path;
+    std::optional<jsn::value> config;
+    std::optional<snapshot> data;
+    bool serving = false;  // Set in the children that run requests
+  };
+
+  static resident_state resident;
+  static volatile std::sig_atomic_t stopping = 0;
+
+  const jsn::value *resident_config(const std::string &path) noexcept
+  {
+    return resident.serving && resident.config && path == resident.config_path ? &*resident.config : nullptr;
+  }
+
+  const snapshot *resident_snapshot(const std::string &path) noexcept
+  {
+    return resident.serving && resident.data && path == resident.data_path ? &*resident.data : nullptr;
+  }
+
+  std::string socket_path()
+  {
+    const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+    std::string dir = runtime && *runtime ? std::string(runtime) + "/meow" : std::format("/tmp/meow-{}", ::getuid());
+    return dir + "/meowd.sock";
+  }
+
+  // The directory holding the socket, only trusted while it is ours and nobody else can get into it: anyone who could
+  // plant a socket there would be handed the client's environment and terminal
+  static bool is_private_dir(const std::string &dir)
+  {
+    struct stat st{};
+    return ::lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::getuid() && (st.st_mode & 0777) == 0700;
+  }
+
+  static bool is_own_peer(int sock)
+  {
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    return ::getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == ::getuid();
+  }
+
+  static bool make_address(const std::string &path, sockaddr_un &addr)
+  {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+      return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+  }
+
+  static std::string encode_request(std::span<char *const> argv)
+  {
+    std::string msg;
+    auto field = [&](std::string_view f)
+    {
+      msg.append(f);
+      msg += '\0';
+    };
+
+    std::error_code ec;
+    field(MAGIC);
+    field(std::filesystem::current_path(ec).string());
+    field(std::to_string(argv.size()));
+    for (const char *arg : argv) field(arg);
+
+    std::size_t envc = 0;
+    for (char **e = environ; *e; ++e) ++envc;
+    field(std::to_string(envc));
+    for (char **e = environ; *e; ++e) field(*e);
+    return msg;
+  }
+
+  static std::optional<request> decode_request(std::string_view msg)
+  {
+    std::vector<std::string_view> fields;
+    while (!msg.empty())
+    {
+      std::size_t end = msg.find('\0');
+      if (end == std::string_view::npos)
+        return std::nullopt;
+      fields.push_back(msg.substr(0, end));
+      msg.remove_prefix(end + 1);
+    }
+
+    std::size_t pos = 0;
+    auto next = [&]() -> std::optional<std::string_view>
+    {
+      return pos < fields.size() ? std::optional(fields[pos++]) : std::nullopt;
+    };
+    auto count = [&]() -> std::optional<std::size_t>
+    {
+      auto f = next();
+      if (!f)
+        return std::nullopt;
+      std::size_t n = 0;
+      auto [ptr, ec] = std::from_chars(f->data(), f->data() + f->size(), n);
+      return ec == std::errc{} && ptr == f->data() + f->size() && n <= fields.size() ? std::optional(n) : std::nullopt;
+    };
+
+    request req;
+    if (next() != MAGIC)
+      return std::nullopt;
+
+    auto cwd = next();
+    auto argc = count();
+    if (!cwd || !argc || *argc < 2)
+      return std::nullopt;
+    req.cwd = *cwd;
+    for (std::size_t i = 0; i < *argc; ++i)
+    {
+      auto arg = next();
+      if (!arg)
+        return std::nullopt;
+      req.args.emplace_back(*arg);
+    }
+
+    auto envc = count();
+    if (!envc)
+      return std::nullopt;
+    for (std::size_t i = 0; i < *envc; ++i)
+    {
+      auto var = next();
+      if (!var)
+        return std::nullopt;
+      req.env.emplace_back(*var);
+    }
+    return req;
+  }
+
+  static bool send_request(int sock, std::string_view msg)
+  {
+    const int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+    iovec iov{const_cast<char *>(msg.data()), msg.size()};
+
+    msghdr m{};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+
+    cmsghdr *c = CMSG_FIRSTHDR(&m);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    return ::sendmsg(sock, &m, MSG_NOSIGNAL) == static_cast<ssize_t>(msg.size());
+  }
+
+  // The request and the three descriptors that came with it, nothing if it wasn't a well-formed request
+  static std::optional<std::pair<request, std::array<int, 3>>> receive_request(int conn)
+  {
+    std::string buf(MAX_REQUEST, '\0');
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)]{};
+    iovec iov{buf.data(), buf.size()};
+
+    msghdr m{};
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+
+    ssize_t n = ::recvmsg(conn, &m, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+      return std::nullopt;
+
+    std::vector<int> fds;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c))
+    {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        continue;
+      std::size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+        fds.push_back(fd);
+      }
+    }
+
+    auto req = (m.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ? std::nullopt : decode_request(std::string_view(buf.data(), n));
+    if (!req || fds.size() != 3)
+    {
+      for (int fd : fds) ::close(fd);
+      return std::nullopt;
+    }
+    return std::pair{std::move(*req), std::array{fds[0], fds[1], fds[2]}};
+  }
+
+  std::optional<int> forward(std::span<char *const> argv)
+  {
+    if (std::getenv("MEOW_NO_DAEMON") || !runs_detached(argv))
+      return std::nullopt;
+
+    const std::string path = socket_path();
+    sockaddr_un addr;
+    if (!make_address(path, addr) || !is_private_dir(std::filesystem::path(path).parent_path().string()))
+      return std::nullopt;
+
+    int sock = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+      return std::nullopt;
+
+    // Nothing has run yet if any of these fails, so the command can still run here. The request is only put together
+    // once the daemon on the other end turned out to run as us.
+    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || !is_own_peer(sock))
+    {
+      ::close(sock);
+      return std::nullopt;
+    }
+    const std::string msg = encode_request(argv);
+    if (msg.size() > MAX_REQUEST || !send_request(sock, msg))
+    {
+      ::close(sock);
+      return std::nullopt;
+    }
+
+    int status = 0;
+    ssize_t n;
+    while ((n = ::recv(sock, &status, sizeof(status), 0)) < 0 && errno == EINTR) {}
+    ::close(sock);
+
+    if (n != sizeof(status))
+    {
+      std::println(stderr, "[ERROR]: The meow daemon went away while running the command");
+      return EXIT_FAILURE;
+    }
+    return status;
+  }
+
+  static void reload()
+  {
+    // A broken file is reported by the commands that read it, the daemon just doesn't keep a copy
+    recoverable_errors guard;
+    try
+    {
+      jsn::value config;
+      if (get_json(resident.config_path, config))
+        resident.config = std::move(config);
+      else
+        resident.config.reset();
+    }
+    catch (const command_error &)
+    {
+      resident.config.reset();
+    }
+
+    try
+    {
+      auto data = snapshot::load(resident.data_path);
+      if (data)
+        resident.data = std::move(*data);
+      else
+        resident.data.reset();
+    }
+    catch (const command_error &)
+    {
+      resident.data.reset();
+    }
+  }
+
+  // Reads all pending events, true if any of them touched a file the resident state comes from
+  static bool drain_events(int watcher)
+  {
+    const std::string config_name = std::filesystem::path(resident.config_path).filename().string();
+    const std::string data_name = std::filesystem::path(resident.data_path).filename().string();
+    const std::string journal_name = std::filesystem::path(resident.data_path).replace_extension(".log").filename().string();
+
+    bool relevant = false;
+    alignas(inotify_event) char buf[16 * 1024];
+    for (;;)
+    {
+      ssize_t n = ::read(watcher, buf, sizeof(buf));
+      if (n <= 0)
+        return relevant;
+
+      for (char *p = buf; p < buf + n;)
+      {
+        auto *ev = reinterpret_cast<inotify_event *>(p);
+        std::string_view name = ev->len ? std::string_view(ev->name) : std::string_view{};
+        if ((ev->mask & IN_Q_OVERFLOW) || name == config_name || name == data_name || name == journal_name)
+          relevant = true;
+        p += sizeof(inotify_event) + ev->len;
+      }
+    }
+  }
+
+  [[noreturn]] static void run_request(request &req, const std::array<int, 3> &fds, int listener, int watcher)
+  {
+    ::close(listener);
+    ::close(watcher);
+
+    sigset_t none;
+    sigemptyset(&none);
+    ::sigprocmask(SIG_SETMASK, &none, nullptr);
+    std::signal(SIGCHLD, SIG_DFL);
+    std::signal(SIGPIPE, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    std::signal(SIGINT, SIG_DFL);
+
+    // Own group, so the whole request (including anything it spawns) can be stopped at once
+    ::setpgid(0, 0);
+
+    for (int i = 0; i < 3; ++i)
+    {
+      ::dup2(fds[i], i);
+      if (fds[i] > 2)
+        ::close(fds[i]);
+    }
+
+    if (::chdir(req.cwd.c_str()) != 0)
+      std::println(stderr, "[WARNING]: Can't enter {}, running in the daemon's directory", req.cwd);
+
+    // putenv keeps pointers to the strings, req outlives the process
+    ::clearenv();
+    for (auto &var : req.env) ::putenv(var.data());
+
+    resident.serving = true;
+    std::exit(run_command(req.args));
+  }
+
+  static void on_stop(int) { stopping = 1; }
+  static void on_child(int) {}
+
+  void serve(const std::vector<std::string> &args)
+  {
+    if (args.size() != 2)
+      handle_error(std::format("Usage: {} daemon", args[0]));
+
+    const std::string path = socket_path();
+    sockaddr_un addr;
+    if (!make_address(path, addr))
+      handle_error(std::format("Socket path {} is too long", path));
+
+    std::error_code ec;
+    const std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    std::filesystem::create_directories(dir, ec);
+    if (ec || ::chmod(dir.c_str(), 0700) != 0 || !is_private_dir(dir.string()))
+      handle_error(std::format("Failed to create {}", dir.string()));
+
+    // Refuse to take over from a live daemon, but clean up after a dead one
+    if (int probe = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0); probe >= 0)
+    {
+      bool alive = ::connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+      ::close(probe);
+      if (alive)
+        handle_error(std::format("A meow daemon is already listening on {}", path));
+    }
+    ::unlink(path.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listener, 64) != 0)
+      handle_error(std::format("Failed to listen on {}: {}", path, std::strerror(errno)));
+
+    resident.config_path = paths::config_path();
+    resident.data_path = paths::data_path();
+
+    int watcher = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher < 0)
+      handle_error(std::format("Failed to set up inotify: {}", std::strerror(errno)));
+
+    // Directories rather than files: saves replace the files by renaming over them
+    for (const std::string &file : {resident.config_path, resident.data_path})
+    {
+      const std::filesystem::path parent = std::filesystem::path(file).parent_path();
+      std::filesystem::create_directories(parent, ec);
+      if (::inotify_add_watch(watcher, parent.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE) < 0)
+        handle_error(std::format("Failed to watch {}: {}", parent.string(), std::strerror(errno)));
+    }
+
+    reload();
+
+    // SIGCHLD stays blocked except inside ppoll, so an exit can't slip in between reaping and waiting. So do SIGTERM
+    // and SIGINT, or one arriving just before ppoll would only be noticed at the next request.
+    sigset_t blocked, waiting;
+    sigemptyset(&blocked);
+    for (int sig : {SIGCHLD, SIGTERM, SIGINT})
+      sigaddset(&blocked, sig);
+    ::sigprocmask(SIG_BLOCK, &blocked, &waiting);
+    for (int sig : {SIGCHLD, SIGTERM, SIGINT})
+      sigdelset(&waiting, sig);
+
+    struct sigaction sa{};
+    sa.sa_handler = on_child;
+    ::sigaction(SIGCHLD, &sa, nullptr);
+    sa.sa_handler = on_stop;
+    ::sigaction(SIGTERM, &sa, nullptr);
+    ::sigaction(SIGINT, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::println("meow daemon listening on {}", path);
+    std::fflush(stdout);
+
+    std::map<pid_t, int> running;  // request child -> client connection
+
+    while (!stopping)
+    {
+      // Report finished requests
+      int status = 0;
+      for (pid_t pid; (pid = ::waitpid(-1, &status, WNOHANG)) > 0;)
+      {
+        auto it = running.find(pid);
+        if (it == running.end())
+          continue;
+
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : EXIT_FAILURE;
+        (void)::send(it->second, &code, sizeof(code), MSG_NOSIGNAL);
+        ::close(it->second);
+        running.erase(it);
+      }
+
+      std::vector<pollfd> fds = {{watcher, POLLIN, 0}, {listener, POLLIN, 0}};
+      for (const auto &[pid, conn] : running) fds.push_back({conn, POLLIN, 0});
+
+      if (::ppoll(fds.data(), fds.size(), nullptr, &waiting) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        handle_error(std::format("poll failed: {}", std::strerror(errno)));
+      }
+
+      // File changes first, so a request arriving right after a commit sees it
+      if ((fds[0].revents & POLLIN) && drain_events(watcher))
+        reload();
+
+      // Clients never send anything after the request, so readable means they hung up (Ctrl-C)
+      std::size_t i = 2;
+      for (const auto &[pid, conn] : running)
+        if (fds[i++].revents & (POLLIN | POLLHUP | POLLERR))
+          ::kill(-pid, SIGTERM);
+
+      if (!(fds[1].revents & POLLIN))
+        continue;
+
+      int conn = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (conn < 0)
+        continue;
+
+      // Only serve our own user
+      auto received = is_own_peer(conn) ? receive_request(conn) : std::nullopt;
+      if (!received)
+      {
+        ::close(conn);
+        continue;
+      }
+
+      auto &[req, client_fds] = *received;
+      pid_t pid = ::fork();
+      if (pid == 0)
+        run_request(req, client_fds, listener, watcher);
+
+      for (int fd : client_fds) ::close(fd);
+      if (pid < 0)
+      {
+        int code = EXIT_FAILURE;
+        (void)::send(conn, &code, sizeof(code), MSG_NOSIGNAL);
+        ::close(conn);
+        continue;
+      }
+      running.emplace(pid, conn);
+    }
+
+    ::unlink(path.c_str());
+    for (const auto &[pid, conn] : running) ::kill(-pid, SIGTERM);
+  }
+}  // namespace meow::daemon
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "./json.hpp"
+#include "./snapshot.hpp"
+
+/* Optional resident server
+ *
+ * NOTE: `meow daemon` keeps the parsed config and the data snapshot in memory and listens on a Unix socket
+ *  ($XDG_RUNTIME_DIR/meow/meowd.sock). A `meow` invocation first tries the socket; when a daemon answers, it sends
+ *  its arguments, working directory, environment and stdin/stdout/stderr (SCM_RIGHTS), and the daemon runs the
+ *  command in a forked child that starts with everything already loaded. The client exits with the child's status.
+ *  Without a daemon, or with MEOW_NO_DAEMON set, commands run in-process as usual.
+ *
+ *  Both ends check the other: the client only uses a socket directory that it owns with mode 0700 and a daemon that
+ *  runs as the same user (SO_PEERCRED), the daemon only serves its own user. Anything else runs the command here.
+ *
+ *  The config and data directories are watched with inotify, so edits from anywhere (including the daemon's own
+ *  children) are picked up before the next request is served.
+ *
+ *  Only commands that never need the terminal are forwarded (see `runs_detached`): the child is not in the
+ *  terminal's foreground process group, so pagers, editors and prompts always run in the client itself.
+ */
+
+namespace meow::daemon
+{
+  [[nodiscard]] std::string socket_path();
+
+  // Runs the command in a daemon if one is listening, returns the exit status or nothing if it has to run here
+  // argv as main got it, so a forwarded command never copies it into strings
+  std::optional<int> forward(std::span<char *const> argv);
+
+  // `meow daemon`: serves requests until killed
+  void serve(const std::vector<std::string> &args);
+
+  // Resident copies, only inside a request served by the daemon and only for the paths they were loaded from
+  [[nodiscard]] const jsn::value *resident_config(const std::string &path) noexcept;
+  [[nodiscard]] const snapshot *resident_snapshot(const std::string &path) noexcept;
+}  // namespace meow::daemon
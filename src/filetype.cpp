@@ -0,0 +1,139 @@
+#include "./filetype.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "./hexdump.hpp"
+#include "./paths.hpp"
+#include "./utils.hpp"
+
+namespace meow::filetype
+{
+  static constexpr std::array<std::string_view, 4> NAMES = {"text", "source", "binary", "compressed"};
+
+  struct magic
+  {
+    std::string_view bytes;
+    kind type;
+  };
+
+  // Formats that could pass for text, or whose first block happens to have no NUL
+  static constexpr magic MAGICS[] = {
+    {"\x1f\x8b", kind::compressed},                             // gzip
+    {"BZh", kind::compressed},                                  // bzip2
+    {{"\xfd" "7zXZ\0", 6}, kind::compressed},                   // xz
+    {"\x28\xb5\x2f\xfd", kind::compressed},                     // zstd
+    {"\x04\x22\x4d\x18", kind::compressed},                     // lz4
+    {"PK\x03\x04", kind::compressed},                           // zip
+    {"7z\xbc\xaf\x27\x1c", kind::compressed},                   // 7z
+    {"\x7f" "ELF", kind::binary},
+    {"\x89PNG", kind::binary},
+    {"\xff\xd8\xff", kind::binary},                             // JPEG
+    {"GIF8", kind::binary},
+    {"%PDF-", kind::binary},
+    {"SQLite format 3", kind::binary},
+  };
+
+  // Text bat highlights, by extension
+  static constexpr std::string_view SOURCE_EXTENSIONS[] = {
+    ".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", ".hxx", ".rs", ".go", ".java", ".kt", ".py", ".rb", ".js", ".ts",
+    ".jsx", ".tsx", ".lua", ".sh", ".bash", ".zsh", ".fish", ".json", ".yaml", ".yml", ".toml", ".ini", ".xml",
+    ".html", ".css", ".md", ".sql", ".cmake", ".diff", ".patch",
+  };
+
+  std::string_view name(kind k) noexcept { return NAMES[static_cast<std::size_t>(k)]; }
+
+  std::optional<kind> parse(std::string_view name) noexcept
+  {
+    auto it = std::ranges::find(NAMES, name);
+    return it == NAMES.end() ? std::nullopt : std::optional(static_cast<kind>(it - NAMES.begin()));
+  }
+
+  std::string stamp(const struct stat &st)
+  {
+    return std::format("{}:{}:{}:{}", st.st_dev, st.st_ino, st.st_size,
+                       static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec);
+  }
+
+  std::optional<kind> detect(const std::string &path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return std::nullopt;
+
+    char buf[hexdump::SNIFF_SIZE];
+    ssize_t n;
+    do
+      n = ::pread(fd, buf, sizeof(buf), 0);
+    while (n < 0 && errno == EINTR);
+    ::close(fd);
+    if (n < 0)
+      return std::nullopt;
+
+    const std::string_view head(buf, static_cast<std::size_t>(n));
+    for (const auto &[bytes, type] : MAGICS)
+      if (head.starts_with(bytes))
+        return type;
+    if (hexdump::looks_binary(head))
+      return kind::binary;
+
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return std::ranges::find(SOURCE_EXTENSIONS, extension) != std::end(SOURCE_EXTENSIONS) ? kind::source : kind::text;
+  }
+
+  // A type is only recorded for a file that has sat unchanged this long: one still being written to (a log) would
+  // otherwise write a new entry on every show
+  static constexpr std::chrono::seconds SETTLE_TIME{60};
+
+  static std::string cache_dir() { return paths::cache_dir() + "/types"; }
+
+  // One entry per file, named by a hash of its path: "<path>|<stamp>\n<kind>"
+  static std::string entry_path(const std::string &path)
+  {
+    std::uint64_t h = 14695981039346656037ull;
+    for (char c : path)
+      h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return std::format("{}/{:016x}", cache_dir(), h);
+  }
+
+  std::optional<kind> of(const std::string &path)
+  {
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0)
+      return std::nullopt;
+
+    std::string key = std::format("{}|{}", path, stamp(st));
+    std::ranges::replace(key, '\n', ' ');
+    const std::string entry = entry_path(path);
+    if (auto text = meow::read_file(entry); text && text->starts_with(key + '\n'))
+      if (auto recorded = parse(std::string_view(*text).substr(key.size() + 1)))
+        return recorded;
+
+    auto detected = detect(path);
+    if (!detected)
+      return std::nullopt;
+
+    // Best effort: a cache that can't be written only means detecting again next time
+    const auto mtime = std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec)));
+    if (std::chrono::system_clock::now() - mtime >= SETTLE_TIME)
+    {
+      std::error_code ec;
+      std::filesystem::create_directories(cache_dir(), ec);
+      if (!ec)
+        (void)meow::write_file(entry, std::format("{}\n{}", key, name(*detected)));
+    }
+    return detected;
+  }
+}  // namespace meow::filetype
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <sys/stat.h>
+
+/* File types
+ *
+ * NOTE: `show` picks how to present a file from its type: plain text, source code (text bat highlights), binary or
+ *  compressed. The type comes from the first bytes of the file (magic numbers, then the NUL/control-byte test of
+ *  hexdump::looks_binary) and, for text, from its extension.
+ *
+ *  The result is remembered in $XDG_CACHE_HOME/meow/types/, one small entry per file keyed to its path, device,
+ *  inode, size and mtime, and used as is while all of those hold. It never goes through the data file, its journal
+ *  or the snapshot, so `show` stays read-only as far as the data is concerned.
+ *
+ *  A type is only remembered once the file has gone a minute without changing. A file that is still being written
+ *  to, like a log, is sniffed again on every show (one 8KiB read) rather than rewriting its entry every time.
+ */
+
+namespace meow::filetype
+{
+  enum class kind
+  {
+    text,
+    source,
+    binary,
+    compressed
+  };
+
+  [[nodiscard]] std::string_view name(kind k) noexcept;
+  [[nodiscard]] std::optional<kind> parse(std::string_view name) noexcept;
+
+  // What a recorded type is keyed to
+  [[nodiscard]] std::string stamp(const struct stat &st);
+
+  // Reads the first block of the file, nothing when it can't be read
+  [[nodiscard]] std::optional<kind> detect(const std::string &path);
+
+  // The type of the file at `path` (already expanded): the remembered one while it is current, otherwise detected
+  [[nodiscard]] std::optional<kind> of(const std::string &path);
+}  // namespace meow::filetype
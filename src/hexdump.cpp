@@ -0,0 +1,134 @@
+#include "./hexdump.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace meow::hexdump
+{
+  bool looks_binary(std::string_view content)
+  {
+    content = content.substr(0, SNIFF_SIZE);
+    std::size_t control = 0;
+    for (unsigned char c : content)
+    {
+      if (c == 0)
+        return true;
+      // Tabs, line and page breaks, backspace (overstrike) and escape (colours) all show up in text
+      if ((c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\v' && c != '\b' && c != '\033') || c == 0x7f)
+        ++control;
+    }
+    return control * 10 > content.size();
+  }
+
+  int offset_width(std::size_t size)
+  {
+    const int digits = (std::bit_width(size > 0 ? size - 1 : 0) + 3) / 4;
+    return std::max(8, digits);
+  }
+
+  // Columns between the offset separator and the ASCII separator: "xx " per byte, one more space every 8 bytes
+  static std::size_t hex_width(std::size_t bytes_per_row) { return (bytes_per_row - 1) * 3 + (bytes_per_row - 1) / 8 + 2; }
+
+  static std::size_t row_width(std::size_t bytes_per_row, int offset_width)
+  {
+    return static_cast<std::size_t>(offset_width) + 3 + hex_width(bytes_per_row) + 3 + bytes_per_row;
+  }
+
+  std::size_t bytes_per_row(int width, int offset_width)
+  {
+    for (std::size_t n : {32, 16})
+      if (row_width(n, offset_width) <= static_cast<std::size_t>(std::max(width, 0)))
+        return n;
+    return 8;
+  }
+
+  // The two hex digits of each of 16 bytes, in order
+  static void hex16(const unsigned char *in, char *out)
+  {
+#if defined(__SSE2__)
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    // '0' + n, and 'a' - '0' - 10 more where n > 9
+    auto digits = [](__m128i n)
+    {
+      const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+      return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letters);
+    };
+    const __m128i high = digits(_mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+    const __m128i low = digits(_mm_and_si128(bytes, nibble));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_unpackhi_epi8(high, low));
+#else
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    for (int i = 0; i < 16; ++i)
+    {
+      out[2 * i] = DIGITS[in[i] >> 4];
+      out[2 * i + 1] = DIGITS[in[i] & 0x0F];
+    }
+#endif
+  }
+
+  // Printable ASCII as is, anything else as '.'
+  static void printable16(const unsigned char *in, char *out)
+  {
+#if defined(__SSE2__)
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    // Signed compare: bytes from 0x80 up are negative and fail it along with the control characters
+    const __m128i shown = _mm_andnot_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(0x7F)), _mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1F)));
+    const __m128i result = _mm_or_si128(_mm_and_si128(shown, bytes), _mm_andnot_si128(shown, _mm_set1_epi8('.')));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), result);
+#else
+    for (int i = 0; i < 16; ++i)
+      out[i] = in[i] >= 0x20 && in[i] < 0x7F ? static_cast<char>(in[i]) : '.';
+#endif
+  }
+
+  void format_row(std::string_view data, std::size_t row, std::size_t bytes_per_row, int offset_width, std::string &out)
+  {
+    const std::size_t start = row * bytes_per_row;
+    if (start >= data.size())
+      return;
+    const std::size_t count = std::min(bytes_per_row, data.size() - start);
+
+    std::format_to(std::back_inserter(out), "{:0{}x} │ ", start, offset_width);
+    const std::size_t hex_at = out.size();
+    out.append(hex_width(bytes_per_row), ' ');
+    out += " │ ";
+    const std::size_t ascii_at = out.size();
+    out.append(count, ' ');
+
+    unsigned char padded[16];
+    char digits[32];
+    char shown[16];
+    for (std::size_t i = 0; i < count; i += 16)
+    {
+      const std::size_t n = std::min<std::size_t>(16, count - i);
+      const auto *in = reinterpret_cast<const unsigned char *>(data.data() + start + i);
+      // The last bytes of the data go through a copy, the kernels always read 16
+      if (n < 16)
+      {
+        std::memset(padded, 0, sizeof(padded));
+        std::memcpy(padded, in, n);
+        in = padded;
+      }
+      hex16(in, digits);
+      printable16(in, shown);
+
+      for (std::size_t j = 0; j < n; ++j)
+      {
+        char *at = out.data() + hex_at + (i + j) * 3 + (i + j) / 8;
+        at[0] = digits[2 * j];
+        at[1] = digits[2 * j + 1];
+      }
+      std::memcpy(out.data() + ascii_at + i, shown, n);
+    }
+  }
+}  // namespace meow::hexdump
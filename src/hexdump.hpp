@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/* Hex view
+ *
+ * NOTE: Binary files are paged as rows of `offset │ hex bytes │ ASCII` instead of as text. The pager formats only the
+ *  rows it draws, so a large blob costs no more than its first screen. Sixteen bytes at a time are turned into hex
+ *  digits and into their printable form with SSE2 where available, byte by byte otherwise.
+ */
+
+namespace meow::hexdump
+{
+  // Bytes looked at to tell binary content from text
+  inline constexpr std::size_t SNIFF_SIZE = 8192;
+
+  // Binary when the first block has a NUL, or when more than one byte in ten is a control character text doesn't use
+  [[nodiscard]] bool looks_binary(std::string_view content);
+
+  // Hex digits the offsets of `size` bytes need, at least 8
+  [[nodiscard]] int offset_width(std::size_t size);
+
+  // The most bytes per row (32, 16 or 8) whose rows fit `width` columns
+  [[nodiscard]] std::size_t bytes_per_row(int width, int offset_width);
+
+  // Appends row `row` of `data` to `out`, without a newline
+  void format_row(std::string_view data, std::size_t row, std::size_t bytes_per_row, int offset_width, std::string &out);
+}  // namespace meow::hexdump
@@ -0,0 +1,64 @@
+#include "./index.hpp"
+
+namespace meow
+{
+  name_index::name_index(const std::vector<jsn::value> &files, const std::vector<jsn::value> &aliases)
+  {
+    file_names.reserve(files.size());
+    alias_names.reserve(aliases.size());
+    alias_files.reserve(aliases.size());
+
+    for (std::size_t i = 0; i < files.size(); ++i) add_file(member_string(files[i], "name"), i);
+    for (std::size_t i = 0; i < aliases.size(); ++i) add_alias(member_string(aliases[i], "alias"), member_string(aliases[i], "file"), i);
+  }
+
+  // emplace keeps the first entry on duplicates, same as the linear scans it replaces
+  void name_index::add_file(std::string_view name, std::size_t pos) { file_names.emplace(name, pos); }
+
+  void name_index::add_alias(std::string_view alias, std::string_view file, std::size_t pos)
+  {
+    alias_names.emplace(alias, pos);
+    if (alias_files.size() <= pos)
+      alias_files.resize(pos + 1);
+    alias_files[pos] = file;
+  }
+
+  std::optional<std::size_t> name_index::file(std::string_view name) const noexcept
+  {
+    auto it = file_names.find(name);
+    if (it == file_names.end())
+      return std::nullopt;
+    return it->second;
+  }
+
+  std::optional<std::size_t> name_index::alias(std::string_view alias) const noexcept
+  {
+    auto it = alias_names.find(alias);
+    if (it == alias_names.end())
+      return std::nullopt;
+    return it->second;
+  }
+
+  std::optional<std::size_t> name_index::alias_target(std::size_t alias_pos) const noexcept
+  {
+    return alias_pos < alias_files.size() ? file(alias_files[alias_pos]) : std::nullopt;
+  }
+
+  std::optional<std::size_t> name_index::resolve(std::string_view name) const noexcept
+  {
+    if (auto a = alias(name))
+      return alias_target(*a);
+    return file(name);
+  }
+
+  std::uint32_t name_index::hash(std::string_view key) noexcept
+  {
+    std::uint32_t h = 2166136261u;
+    for (unsigned char c : key)
+    {
+      h ^= c;
+      h *= 16777619u;
+    }
+    return h;
+  }
+}  // namespace meow
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "./json.hpp"
+
+namespace meow
+{
+  // A string member of a files/aliases entry, empty when it is missing or not a string
+  [[nodiscard]] inline std::string_view member_string(const jsn::value &entry, std::string_view member)
+  {
+    const jsn::value *v = entry.find(member);
+    return v ? v->string_view_opt().value_or("") : "";
+  }
+
+  // Name -> position lookups over the `files` and `aliases` arrays of the data file.
+  // Keys are copied, so appends can be mirrored with add_file/add_alias; anything else needs a rebuild.
+  class name_index
+  {
+  private:
+    struct key_hash
+    {
+      using is_transparent = void;
+      std::size_t operator()(std::string_view key) const noexcept { return std::hash<std::string_view>{}(key); }
+    };
+    using table = std::unordered_map<std::string, std::size_t, key_hash, std::equal_to<>>;
+
+    table file_names;
+    table alias_names;
+    std::vector<std::string> alias_files;  // alias position -> name of the file it points to
+
+  public:
+    name_index(const std::vector<jsn::value> &files, const std::vector<jsn::value> &aliases);
+
+    // For entries appended to the arrays after the index was built
+    void add_file(std::string_view name, std::size_t pos);
+    void add_alias(std::string_view alias, std::string_view file, std::size_t pos);
+
+    [[nodiscard]] std::optional<std::size_t> file(std::string_view name) const noexcept;
+    [[nodiscard]] std::optional<std::size_t> alias(std::string_view alias) const noexcept;
+    // File an alias points to, if that file is registered
+    [[nodiscard]] std::optional<std::size_t> alias_target(std::size_t alias_pos) const noexcept;
+    // Alias first, then file name, the way `show` resolves its argument
+    [[nodiscard]] std::optional<std::size_t> resolve(std::string_view name) const noexcept;
+
+    // Hash used by the tables persisted in the snapshot
+    [[nodiscard]] static std::uint32_t hash(std::string_view key) noexcept;
+  };
+}  // namespace meow
@@ -0,0 +1,593 @@
+#include "./journal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <print>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./json_stream.hpp"
+#include "./snapshot.hpp"
+#include "./utils.hpp"
+
+namespace meow
+{
+  // Journals smaller than this are never compacted, past it they are once they outgrow the data file
+  static constexpr std::size_t COMPACT_MIN = 64 * 1024;
+
+  // Optimistic attempts before a writer keeps the lock across load and change, so it can't be starved
+  static constexpr int MAX_ATTEMPTS = 8;
+
+  static std::int64_t mtime_ns(const struct stat &st)
+  {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+  }
+
+  static std::string header_line(const struct stat &st)
+  {
+    return std::format("{{\"journal\":1,\"base\":\"{}:{}:{}\"}}\n", st.st_ino, st.st_size, mtime_ns(st));
+  }
+
+  // Last line of a journal whose records a compaction folded into the data file
+  static constexpr std::string_view FOLDED = "{\"folded\":true}\n";
+
+  // Whether a journal that doesn't belong to the current data file still holds records that are in no data file: it
+  // has some, and no compaction marked it as folded after the last one. That happens when the data file is replaced
+  // by hand (or by another program) while changes are pending.
+  static bool holds_unfolded(std::string_view text)
+  {
+    text = text.substr(0, text.rfind('\n') + 1);  // A torn last line was never part of the data
+    return text.starts_with("{\"journal\":") && text.find('\n') + 1 < text.size() && !text.ends_with(FOLDED);
+  }
+
+  // Records under these change what the snapshot holds, anything else (todos) doesn't
+  static bool touches_names(std::string_view path)
+  {
+    return path.starts_with("files") || path.starts_with("aliases");
+  }
+
+  // Up to `size` bytes from `offset`, fewer at the end of the file
+  static std::optional<std::string> read_at(int fd, std::size_t offset, std::size_t size)
+  {
+    std::string out(size, '\0');
+    std::size_t done = 0;
+    while (done < size)
+    {
+      ssize_t n = ::pread(fd, out.data() + done, size - done, static_cast<off_t>(offset + done));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return std::nullopt;
+      if (n == 0)
+        break;
+      done += static_cast<std::size_t>(n);
+    }
+    out.resize(done);
+    return out;
+  }
+
+  // End of the last complete line of a journal of `size` bytes whose first `floor` bytes are known to be whole lines
+  static std::optional<std::size_t> intact_size(int fd, std::size_t size, std::size_t floor)
+  {
+    static constexpr std::size_t CHUNK = 4096;
+    for (std::size_t end = size; end > floor;)
+    {
+      const std::size_t start = end - std::min(CHUNK, end - floor);
+      auto chunk = read_at(fd, start, end - start);
+      if (!chunk || chunk->size() != end - start)
+        return std::nullopt;
+      if (std::size_t nl = chunk->rfind('\n'); nl != std::string::npos)
+        return start + nl + 1;
+      end = start;
+    }
+    return floor;
+  }
+
+  // Walks an existing path without creating anything on the way
+  static jsn::value *locate(jsn::value &data, jsn::path_view path)
+  {
+    jsn::value *current = &data;
+    for (const auto &token : path)
+    {
+      if (token.is_index)
+      {
+        auto *arr = current->get_if<jsn::array_type>();
+        current = arr && token.index < arr->size() ? &(*arr)[token.index] : nullptr;
+      }
+      else
+        current = current->find(token.key);
+
+      if (!current)
+        return nullptr;
+    }
+    return current;
+  }
+
+  // Whether applying a value at `path` would grow an array by more than the one element it appends. The DOM would
+  // fill the gap with nulls; a record that asks for that is damaged, and its index could be anything.
+  static bool opens_gap(const jsn::value &data, jsn::path_view path)
+  {
+    const jsn::value *current = &data;
+    for (const auto &token : path)
+    {
+      if (!token.is_index)
+      {
+        current = current ? current->find(token.key) : nullptr;
+        continue;
+      }
+
+      const auto *arr = current ? current->get_if<jsn::array_type>() : nullptr;
+      const std::size_t size = arr ? arr->size() : 0;
+      if (token.index > size)
+        return true;
+      current = token.index < size ? &(*arr)[token.index] : nullptr;
+    }
+    return false;
+  }
+
+  // Applies a record, returns how many elements it touched
+  static std::expected<std::size_t, std::string> apply_record(jsn::value &data, const jsn::value &record)
+  {
+    const jsn::value *op = record.find("op");
+    const jsn::value *path_str = record.find("path");
+    if (!op || !op->is_string() || !path_str || !path_str->is_string())
+      return std::unexpected("Malformed journal record");
+
+    auto path = jsn::path::compile(path_str->as_string());
+    if (!path)
+      return std::unexpected(path.error());
+
+    const std::string &name = op->as_string();
+    const jsn::value *val = record.find("value");
+    if (opens_gap(data, path->view()))
+      return std::unexpected(std::format("Array index in '{}' is past the end", path->str()));
+
+    if (name == "push" && val)
+    {
+      if (auto r = data.push(path->view(), *val); !r)
+        return std::unexpected(r.error());
+      return 1;
+    }
+
+    if (name == "set" && val)
+    {
+      data.set_nested(path->view(), *val);
+      return 1;
+    }
+
+    jsn::value *target = locate(data, path->view());
+    auto *arr = target ? target->get_if<jsn::array_type>() : nullptr;
+    if (!arr)
+      return std::unexpected(std::format("No array at '{}'", path->str()));
+
+    if (name == "erase")
+    {
+      const jsn::value *member = record.find("member");
+      const jsn::value *equals = record.find("equals");
+      if (!member || !member->is_string() || !equals || !equals->is_string())
+        return std::unexpected("Malformed erase record");
+
+      return std::erase_if(*arr, [&](const jsn::value &v)
+      {
+        const jsn::value *m = v.find(member->as_string());
+        return m && m->string_view_opt() == equals->as_string();
+      });
+    }
+
+    if (name == "erase_at")
+    {
+      const jsn::value *index = record.find("index");
+      if (!index || !index->is_number() || index->as_number() < 0 || index->as_number() >= static_cast<double>(arr->size()))
+        return std::unexpected("Journal record index out of range");
+
+      arr->erase(arr->begin() + static_cast<std::ptrdiff_t>(index->as_number()));
+      return 1;
+    }
+
+    return std::unexpected(std::format("Unknown journal operation '{}'", name));
+  }
+
+  void mutation::record(jsn::value rec)
+  {
+    if (auto r = apply_record(data, rec); !r)
+      throw std::runtime_error(r.error());
+    track(rec["op"].as_string(), rec["path"].as_string());
+    pending.push_back(std::move(rec));
+  }
+
+  // Mirrors appends to files/aliases into the index, anything else that touches them drops it
+  void mutation::track(std::string_view op, std::string_view path)
+  {
+    if (!touches_names(path))
+      return;
+    names_changed = true;
+    if (!index)
+      return;
+
+    if (op == "push" && (path == "files" || path == "aliases"))
+    {
+      const auto &arr = data[std::string(path)].as_array();
+      const jsn::value &entry = arr.back();
+      if (path == "files")
+        index->add_file(member_string(entry, "name"), arr.size() - 1);
+      else
+        index->add_alias(member_string(entry, "alias"), member_string(entry, "file"), arr.size() - 1);
+      return;
+    }
+
+    index.reset();
+  }
+
+  const name_index &mutation::names()
+  {
+    if (!index)
+    {
+      static const jsn::array_type empty;
+      auto array_of = [&](std::string_view member) -> const jsn::array_type &
+      {
+        const jsn::value *v = std::as_const(data).find(member);
+        const jsn::array_type *arr = v ? v->get_if<jsn::array_type>() : nullptr;
+        return arr ? *arr : empty;
+      };
+      index.emplace(array_of("files"), array_of("aliases"));
+    }
+    return *index;
+  }
+
+  void mutation::push(std::string_view path, jsn::value val)
+  {
+    record(jsn::object_type{{"op", "push"}, {"path", path}, {"value", std::move(val)}});
+  }
+
+  std::size_t mutation::erase(std::string_view path, std::string_view member, std::string_view equals)
+  {
+    jsn::value rec = jsn::object_type{{"op", "erase"}, {"path", path}, {"member", member}, {"equals", equals}};
+
+    auto removed = apply_record(data, rec);
+    if (!removed)
+      throw std::runtime_error(removed.error());
+    if (*removed > 0)
+    {
+      track("erase", path);
+      pending.push_back(std::move(rec));
+    }
+    return *removed;
+  }
+
+  void mutation::erase_at(std::string_view path, std::size_t index)
+  {
+    record(jsn::object_type{{"op", "erase_at"}, {"path", path}, {"index", index}});
+  }
+
+  void mutation::set(std::string_view path, jsn::value val)
+  {
+    record(jsn::object_type{{"op", "set"}, {"path", path}, {"value", std::move(val)}});
+  }
+
+  namespace journal
+  {
+    std::string path_for(const std::string &json_path)
+    {
+      return std::filesystem::path(json_path).replace_extension(".log").string();
+    }
+
+    std::string stale_path(const std::string &json_path) { return path_for(json_path) + ".stale"; }
+
+    std::string lock_path(const std::string &json_path)
+    {
+      return std::filesystem::path(json_path).replace_extension(".lock").string();
+    }
+
+    stamp stamp_of(const std::string &json_path)
+    {
+      stamp s;
+      struct stat st{};
+      if (::stat(json_path.c_str(), &st) == 0)
+      {
+        s.json_inode = static_cast<std::uint64_t>(st.st_ino);
+        s.json_size = static_cast<std::uint64_t>(st.st_size);
+        s.json_mtime_ns = mtime_ns(st);
+      }
+      if (::stat(path_for(json_path).c_str(), &st) == 0)
+      {
+        s.journal_inode = static_cast<std::uint64_t>(st.st_ino);
+        s.journal_size = static_cast<std::uint64_t>(st.st_size);
+      }
+      return s;
+    }
+
+    std::expected<void, std::string> apply(jsn::value &data, const jsn::value &record)
+    {
+      if (auto r = apply_record(data, record); !r)
+        return std::unexpected(r.error());
+      return {};
+    }
+
+    std::size_t replay(const std::string &json_path, const struct stat &json_st, jsn::value &data, bool warn)
+    {
+      std::optional<std::string> text = meow::read_file(path_for(json_path));
+      if (!text)
+        return 0;
+
+      // A journal written against another version of the data file has already been folded in, or the data file was
+      // replaced under it. Its records can't be replayed onto a file they weren't written against, but they aren't
+      // dropped either: the next change keeps them aside (see `append`).
+      std::string_view rest = *text;
+      const std::string header = header_line(json_st);
+      if (!rest.starts_with(header))
+      {
+        if (holds_unfolded(rest))
+          std::println(stderr, "[WARNING]: {} was changed outside meow, the changes recorded in {} since are not in it "
+                               "and are left out", json_path, path_for(json_path));
+        return 0;
+      }
+      rest.remove_prefix(header.size());
+
+      std::size_t applied = 0;
+      for (std::size_t nl = rest.find('\n'); nl != std::string_view::npos; nl = rest.find('\n'))
+      {
+        std::string_view line = rest.substr(0, nl);
+        rest.remove_prefix(nl + 1);
+        if (line == FOLDED.substr(0, FOLDED.size() - 1))
+          continue;
+
+        auto record = jsn::try_parse(line);
+        if (!record)
+        {
+          if (warn)
+            std::println(stderr, "[WARNING]: Skipping damaged journal record: {}", line);
+          continue;
+        }
+
+        if (auto r = apply_record(data, *record); !r)
+        {
+          if (warn)
+            std::println(stderr, "[WARNING]: Skipping journal record: {}", r.error());
+          continue;
+        }
+        applied++;
+      }
+      return applied;
+    }
+
+    std::expected<std::size_t, std::string> append(const std::string &json_path, const std::vector<jsn::value> &records)
+    {
+      const std::string log_path = path_for(json_path);
+
+      struct stat st{};
+      if (::stat(json_path.c_str(), &st) != 0)
+        return std::unexpected(std::format("Failed to stat {}", json_path));
+
+      const std::string header = header_line(st);
+      std::string lines;
+      for (const auto &rec : records)
+      {
+        lines += jsn::to_string(rec);
+        lines += '\n';
+      }
+
+      // Keep appending only to a journal that belongs to this data file. Only its first line and its end are read, the
+      // records in between don't matter here.
+      int fd = ::open(log_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+      if (fd >= 0)
+      {
+        struct stat current{};
+        auto first = ::fstat(fd, &current) == 0 ? read_at(fd, 0, header.size()) : std::nullopt;
+        bool usable = first && *first == header;
+        if (usable)
+        {
+          // Cut off a line torn by a crash mid-append, so the next record doesn't get glued onto it
+          const auto size = static_cast<std::size_t>(current.st_size);
+          auto last = read_at(fd, size - 1, 1);
+          if (!last || *last != "\n")
+          {
+            auto intact = intact_size(fd, size, header.size());
+            usable = intact && ::ftruncate(fd, static_cast<off_t>(*intact)) == 0;
+          }
+        }
+        if (!usable)
+        {
+          ::close(fd);
+          fd = -1;
+
+          // Replacing a journal whose records never made it into a data file would lose them, it is kept aside
+          auto old = first && *first != header ? meow::read_file(log_path) : std::nullopt;
+          if (old && holds_unfolded(*old))
+          {
+            // Never over one kept earlier
+            std::string stale = stale_path(json_path);
+            for (int n = 1; ::access(stale.c_str(), F_OK) == 0; ++n)
+              stale = std::format("{}.{}", stale_path(json_path), n);
+            if (std::rename(log_path.c_str(), stale.c_str()) != 0)
+              return std::unexpected(std::format("Failed to keep {} aside as {}: {}", log_path, stale, std::strerror(errno)));
+            std::println(stderr, "[WARNING]: {} was changed outside meow, the changes recorded since are not in it. "
+                                 "They are kept in {}", json_path, stale);
+          }
+        }
+      }
+
+      if (fd < 0)
+      {
+        // Start a fresh journal, the old one (if any) is replaced atomically
+        lines.insert(0, header);
+        if (auto r = meow::write_file(log_path, lines); !r)
+          return std::unexpected(r.error());
+        return lines.size();
+      }
+
+      bool ok = meow::write_all(fd, lines) && ::fsync(fd) == 0;
+      struct stat log_st{};
+      ok = ok && ::fstat(fd, &log_st) == 0;
+      ::close(fd);
+
+      if (!ok)
+        return std::unexpected(std::format("Failed to append to {}: {}", log_path, std::strerror(errno)));
+      return static_cast<std::size_t>(log_st.st_size);
+    }
+
+    std::optional<bool> names_changed(const std::string &json_path, std::uint64_t inode, std::uint64_t offset)
+    {
+      int fd = ::open(path_for(json_path).c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        return std::nullopt;
+
+      struct stat st{};
+      std::optional<std::string> tail;
+      if (::fstat(fd, &st) == 0 && static_cast<std::uint64_t>(st.st_ino) == inode && static_cast<std::uint64_t>(st.st_size) >= offset)
+        tail = read_at(fd, offset, static_cast<std::size_t>(st.st_size - offset));
+      ::close(fd);
+      if (!tail)
+        return std::nullopt;
+
+      // A torn last line is ignored by replay too, a damaged record might have been anything. Only the path of each
+      // record is built, not the value it carries.
+      std::string_view rest = *tail;
+      for (std::size_t nl = rest.find('\n'); nl != std::string_view::npos; nl = rest.find('\n'))
+      {
+        const std::string_view line = rest.substr(0, nl);
+        rest.remove_prefix(nl + 1);
+
+        std::optional<jsn::value> path;
+        try
+        {
+          jsn::string_source src(line);
+          path = jsn::find_member(src, "path", line.size());
+        }
+        catch (const jsn::parse_error &)
+        {
+          return true;
+        }
+        if (!path || touches_names(path->string_view_opt().value_or("files")))
+          return true;
+      }
+      return false;
+    }
+
+    std::expected<void, std::string> compact(const std::string &json_path, const jsn::value &data)
+    {
+      // The journal is left in place: its base no longer matches the new data file so it is ignored from now on, but a
+      // reader that opened the old data file just before still gets to replay it. It is marked as folded first, so it
+      // isn't mistaken for one whose data file was replaced by hand.
+      const std::string log_path = path_for(json_path);
+      int fd = ::open(log_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+      if (fd >= 0)
+      {
+        const bool marked = meow::write_all(fd, FOLDED) && ::fsync(fd) == 0;
+        ::close(fd);
+        if (!marked)
+          return std::unexpected(std::format("Failed to mark {} as folded: {}", log_path, std::strerror(errno)));
+      }
+      return meow::write_json_file(json_path, data);
+    }
+  }  // namespace journal
+
+  bool load_data(const std::string &path, jsn::value &data)
+  {
+    struct stat st{};
+    if (!meow::get_json(path, data, &st))
+      return false;
+
+    journal::replay(path, st, data);
+    return true;
+  }
+
+  void commit_or_error(const std::string &path, const jsn::value &data, const mutation &m)
+  {
+    if (m.records().empty())
+      return;
+
+    struct stat before{};
+    const std::uint64_t covered = ::stat(journal::path_for(path).c_str(), &before) == 0 ? before.st_size : 0;
+
+    auto journal_size = journal::append(path, m.records());
+    if (!journal_size)
+      handle_error(std::format("Failed to write journal: \n     {}", journal_size.error()));
+
+    bool compacted = false;
+    std::error_code ec;
+    std::uintmax_t data_size = std::filesystem::file_size(path, ec);
+    if (!ec && *journal_size > std::max<std::uintmax_t>(COMPACT_MIN, data_size))
+    {
+      if (auto r = journal::compact(path, data); !r)
+        handle_error(std::format("Failed to compact journal: \n     {}", r.error()));
+      compacted = true;
+    }
+
+    // Keep the snapshot current so the next read-only command doesn't rebuild it. Records that leave files and aliases
+    // alone only move the journal offset it covers; it is rewritten when they changed or the data file was.
+    if (compacted || m.changes_names() || !snapshot::extend(path, covered, *journal_size))
+      (void)snapshot::store(path, data);
+  }
+
+  static data_batch *open_batch = nullptr;
+
+  data_batch::data_batch(std::string path) : path(std::move(path)), lock(journal::lock_path(this->path)), previous(open_batch)
+  {
+    if (!lock.locked())
+      handle_error(std::format("Failed to lock {}: {}", journal::lock_path(this->path), std::strerror(errno)));
+    if (!load_data(this->path, loaded))
+      handle_error(std::format("Failed to load {}", this->path));
+    open_batch = this;
+  }
+
+  data_batch::~data_batch() { open_batch = previous; }
+
+  data_batch *data_batch::current() noexcept { return open_batch; }
+
+  void data_batch::commit()
+  {
+    commit_or_error(path, loaded, changes);
+    changes.clear_records();
+  }
+
+  bool update_data(const std::string &path, const std::function<void(jsn::value &, mutation &)> &change)
+  {
+    if (open_batch && open_batch->path == path)
+    {
+      change(open_batch->loaded, open_batch->changes);
+      return true;
+    }
+
+    const std::string lock_path = journal::lock_path(path);
+
+    for (int attempt = 1;; ++attempt)
+    {
+      std::optional<file_lock> lock;
+      if (attempt == MAX_ATTEMPTS)
+        lock.emplace(lock_path);
+
+      // Taken before reading, so anything committed after it shows up as a difference below
+      const journal::stamp before = journal::stamp_of(path);
+
+      jsn::value data;
+      if (!load_data(path, data))
+        return false;
+
+      mutation m(data);
+      change(data, m);
+      if (m.records().empty())
+        return true;
+
+      if (!lock)
+        lock.emplace(lock_path);
+      if (!lock->locked())
+        handle_error(std::format("Failed to lock {}: {}", lock_path, std::strerror(errno)));
+
+      if (journal::stamp_of(path) != before)
+        continue;
+
+      commit_or_error(path, data, m);
+      return true;
+    }
+  }
+}  // namespace meow
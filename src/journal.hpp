@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "./index.hpp"
+#include "./json.hpp"
+#include "./utils.hpp"
+
+/* Write-ahead journal for the data file
+ *
+ * NOTE: Commands don't rewrite `data.json` for every change. Each change is recorded as one line of compact JSON in
+ *  `data.log` next to it, appended and fsync'ed, and replayed on top of `data.json` whenever the data is loaded.
+ *  Once the journal outgrows the data file it is folded back into `data.json` and dropped.
+ *
+ *  The first line of the journal names the exact `data.json` (inode, size, mtime) it applies to. After a compaction
+ *  or a hand edit of `data.json` that no longer matches and the old journal is ignored, so records are never applied
+ *  twice. A torn last line (crash mid-append) is ignored too. A compaction ends the journal with a {"folded":true}
+ *  line; a journal without one that no longer matches lost its data file to a hand edit, and its records are in no
+ *  data file. Loading warns about it, and the next change keeps it as `data.log.stale` instead of starting over it.
+ *
+ *  Records:
+ *    {"op":"push","path":"files","value":{...}}              append to the array at path
+ *    {"op":"erase","path":"files","member":"name","equals":"x"} drop every element whose member equals the string
+ *    {"op":"erase_at","path":"todos","index":2}              drop one element
+ *    {"op":"set","path":"todos[2].done","value":true}         replace the value at path
+ */
+
+namespace meow
+{
+  // A batch of changes to the loaded data: each change is applied to the in-memory value right away and recorded
+  // for `commit_or_error` to append to the journal.
+  class mutation
+  {
+  private:
+    jsn::value &data;
+    std::vector<jsn::value> pending;
+    std::optional<name_index> index;
+    bool names_changed = false;
+
+    void record(jsn::value rec);
+    void track(std::string_view op, std::string_view path);
+
+  public:
+    explicit mutation(jsn::value &data) : data(data) {}
+
+    void push(std::string_view path, jsn::value val);
+    // Returns how many elements were removed, nothing is recorded when that is 0
+    std::size_t erase(std::string_view path, std::string_view member, std::string_view equals);
+    void erase_at(std::string_view path, std::size_t index);
+    void set(std::string_view path, jsn::value val);
+
+    [[nodiscard]] const std::vector<jsn::value> &records() const noexcept { return pending; }
+    void clear_records() noexcept
+    {
+      pending.clear();
+      names_changed = false;
+    }
+
+    // Whether any recorded change touched files or aliases, the part of the data the snapshot holds
+    [[nodiscard]] bool changes_names() const noexcept { return names_changed; }
+
+    // Index over the current files and aliases, kept up to date across pushes so that a batch of adds
+    // doesn't rebuild it every time
+    [[nodiscard]] const name_index &names();
+  };
+
+  namespace journal
+  {
+    // Identifies one state of the data file together with its journal
+    struct stamp
+    {
+      std::uint64_t json_inode = 0;
+      std::uint64_t json_size = 0;
+      std::int64_t json_mtime_ns = 0;
+      std::uint64_t journal_inode = 0;
+      std::uint64_t journal_size = 0;
+
+      bool operator==(const stamp &) const = default;
+    };
+
+    [[nodiscard]] std::string path_for(const std::string &json_path);
+    [[nodiscard]] std::string lock_path(const std::string &json_path);
+    // Where a journal whose data file was replaced under it is kept, with ".1", ".2"... appended when that is taken
+    [[nodiscard]] std::string stale_path(const std::string &json_path);
+    [[nodiscard]] stamp stamp_of(const std::string &json_path);
+
+    std::expected<void, std::string> apply(jsn::value &data, const jsn::value &record);
+
+    // Replays the journal belonging to the data file that was read (`json_st`) onto `data`, returns how many records
+    // were applied. Records that don't apply are skipped, with a warning unless `warn` is false.
+    std::size_t replay(const std::string &json_path, const struct stat &json_st, jsn::value &data, bool warn = true);
+
+    // Whether the records from byte `offset` on touch files or aliases, nothing when the journal isn't the one with
+    // inode `inode` anymore or is shorter than that
+    [[nodiscard]] std::optional<bool> names_changed(const std::string &json_path, std::uint64_t inode, std::uint64_t offset);
+
+    // Appends and fsyncs the records, returns the size of the journal afterwards
+    std::expected<std::size_t, std::string> append(const std::string &json_path, const std::vector<jsn::value> &records);
+
+    // Writes `data` to the data file, which retires the journal
+    std::expected<void, std::string> compact(const std::string &json_path, const jsn::value &data);
+  }  // namespace journal
+
+  // get_json plus journal replay, for commands that change the data
+  bool load_data(const std::string &path, jsn::value &data);
+
+  // Appends the mutation to the journal, compacting when it has grown too large, and keeps the snapshot current (see
+  // snapshot.hpp). Expects the lock to be held.
+  void commit_or_error(const std::string &path, const jsn::value &data, const mutation &m);
+
+  // Runs many commands against one copy of the data, committed once: while a batch is open, `update_data` hands every
+  // change the batch's data and mutation instead of loading and committing on its own. The lock is held throughout.
+  class data_batch
+  {
+  private:
+    std::string path;
+    file_lock lock;
+    jsn::value loaded;
+    mutation changes{loaded};
+    data_batch *previous;
+
+  public:
+    explicit data_batch(std::string path);
+    ~data_batch();
+    data_batch(const data_batch &) = delete;
+    data_batch &operator=(const data_batch &) = delete;
+
+    [[nodiscard]] static data_batch *current() noexcept;
+
+    [[nodiscard]] const std::string &data_path() const noexcept { return path; }
+    [[nodiscard]] const jsn::value &data() const noexcept { return loaded; }
+    [[nodiscard]] std::size_t pending() const noexcept { return changes.records().size(); }
+
+    friend bool update_data(const std::string &path, const std::function<void(jsn::value &, mutation &)> &change);
+
+    // Appends everything recorded so far, as one write
+    void commit();
+  };
+
+  // Loads the data, runs `change` and commits what it recorded. `change` may run more than once: when another process
+  // commits in between it is rerun on fresh data, so it should only change things through the mutation and must not
+  // accumulate state across runs. Returns false when the data couldn't be loaded.
+  bool update_data(const std::string &path, const std::function<void(jsn::value &, mutation &)> &change);
+}  // namespace meow
@@ -3,16 +3,25 @@
 #include <cstdio>
 #include <string>
 #include <string_view>
-#include <sstream>
+#include <algorithm>
+#include <utility>
 #include <vector>
 #include <map>
 #include <variant>
 #include <stdexcept>
 #include <cctype>
+#include <cerrno>
+#include <charconv>
 #include <expected>
 #include <format>
 #include <print>
 
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace jsn
 {
   Value_type value::get_type_from_index() const
@@ -170,18 +179,20 @@ namespace jsn
 
     return std::get<object_type>(data);
   }
+  static const value null_value;
+
   // Array element access
-  const value value::operator[](const std::size_t index) const
+  const value &value::operator[](const std::size_t index) const
   {
     if (!is_array())
       throw std::runtime_error(std::format("Type error: expected array, got {}", type_to_string(type())));
     const auto &arr = std::get<array_type>(data);
     if (index >= arr.size())
-      return value();
+      return null_value;
     return arr[index];
   }
 
-  const value value::operator[](int index) const { return (*this)[static_cast<std::size_t>(index)]; }
+  const value &value::operator[](int index) const { return (*this)[static_cast<std::size_t>(index)]; }
 
   value &value::operator[](std::size_t index)
   {
@@ -205,40 +216,23 @@ namespace jsn
     auto &obj = std::get<object_type>(data);
     auto it = obj.find(key);
     if (it == obj.end())
-    {
-      obj[key] = value();
-    }
+      it = obj.emplace(key, value()).first;
     return it->second;
   }
 
   value &value::operator[](const std::string &key) { return (*this)[key.c_str()]; }
   // For string literals and const char*
-  const value value::operator[](const char *key) const
+  const value &value::operator[](const char *key) const
   {
     if (!is_object())
       throw std::runtime_error(std::format("Type error: expected object, got {}", type_to_string(type())));
 
-    const auto &obj = std::get<object_type>(data);
-    auto it = obj.find(key);
-    if (it == obj.end())
-      return value();
-
-    return it->second;
+    const value *found = find(key);
+    return found ? *found : null_value;
   }
 
   // For std::string
-  const value value::operator[](const std::string &key) const
-  {
-    if (!is_object())
-      throw std::runtime_error(std::format("Type error: expected object, got {}", type_to_string(type())));
-
-    const auto &obj = std::get<object_type>(data);
-    auto it = obj.find(key);
-    if (it == obj.end())
-      return value();
-
-    return it->second;
-  }
+  const value &value::operator[](const std::string &key) const { return (*this)[key.c_str()]; }
 
   // Safe access with std::expected (C++23)
   std::expected<bool, std::string> value::expect_boolean() const noexcept
@@ -322,6 +316,46 @@ namespace jsn
     return std::get<object_type>(data);
   }
 
+  const value *value::find(std::string_view key) const noexcept
+  {
+    const auto *obj = std::get_if<object_type>(&data);
+    if (!obj)
+      return nullptr;
+
+    auto it = obj->find(key);
+    return it == obj->end() ? nullptr : &it->second;
+  }
+
+  value *value::find(std::string_view key) noexcept
+  {
+    return const_cast<value *>(std::as_const(*this).find(key));
+  }
+
+  const value *value::find(std::size_t index) const noexcept
+  {
+    const auto *arr = std::get_if<array_type>(&data);
+    if (!arr || index >= arr->size())
+      return nullptr;
+
+    return &(*arr)[index];
+  }
+
+  std::optional<std::string_view> value::string_view_opt() const noexcept
+  {
+    if (!is_string())
+      return std::nullopt;
+
+    return std::string_view(std::get<std::string>(data));
+  }
+
+  std::optional<value::array_view> value::array_view_opt() const noexcept
+  {
+    if (!is_array())
+      return std::nullopt;
+
+    return array_view(std::get<array_type>(data));
+  }
+
   value::object_type &value::mut_object()
   {
     if (!is_object())
@@ -346,160 +380,152 @@ namespace jsn
     }
   }
 
-  void value::set_nested(const std::string &path, const value &val)
+  std::expected<path, std::string> path::compile(std::string_view str)
   {
-    if (path.empty())
-      throw std::invalid_argument("Path cannot be empty");
-
-    // Split the path by dots to get individual keys
-    std::vector<std::string> keys;
-    std::string current_key;
-    std::istringstream path_stream(path);
+    path result;
+    result.source = std::make_unique<char[]>(str.size());
+    result.length = str.size();
+    std::copy(str.begin(), str.end(), result.source.get());
 
-    while (std::getline(path_stream, current_key, '.')) keys.push_back(current_key);
+    std::string_view error = tokenize_path(result.str(), [&](path_token t) { result.tokens.push_back(t); });
+    if (!error.empty())
+      return std::unexpected(std::format("{}: {}", error, str));
+    if (result.tokens.empty())
+      return std::unexpected(std::format("Invalid path format: {}", str));
 
-    if (keys.empty())
-      throw std::invalid_argument("Invalid path format");
+    return result;
+  }
 
-    // Navigate through the nested structure
-    if (!is_object())
-    {
-      // Convert to an empty object if this isn't already an object
-      data = object_type{};
-    }
+  path::path(const path &other) : source(std::make_unique<char[]>(other.length)), length(other.length), tokens(other.tokens)
+  {
+    std::copy(other.source.get(), other.source.get() + length, source.get());
 
-    object_type *current_obj = &std::get<object_type>(data);
+    // Keys are views into the source, point them at our own copy
+    for (auto &t : tokens)
+      if (!t.is_index)
+        t.key = std::string_view(source.get() + (t.key.data() - other.source.get()), t.key.size());
+  }
 
-    // Navigate to the second-to-last key
-    for (size_t i = 0; i < keys.size() - 1; ++i)
-    {
-      const auto &key = keys[i];
+  // Tokens point into the heap buffer, which moves along with them
+  path::path(path &&other) noexcept
+      : source(std::move(other.source)), length(std::exchange(other.length, 0)), tokens(std::move(other.tokens))
+  {
+  }
 
-      // If the key doesn't exist, create a new object
-      if (current_obj->find(key) == current_obj->end() || !(*current_obj)[key].is_object())
-        (*current_obj)[key] = object_type{};
+  path &path::operator=(const path &other)
+  {
+    if (this != &other)
+      *this = path(other);
+    return *this;
+  }
 
-      // Move to the next level
-      current_obj = &std::get<object_type>((*current_obj)[key].data);
+  path &path::operator=(path &&other) noexcept
+  {
+    if (this != &other)
+    {
+      source = std::move(other.source);
+      length = std::exchange(other.length, 0);
+      tokens = std::move(other.tokens);
     }
+    return *this;
+  }
 
-    // Set the value at the final key
-    (*current_obj)[keys.back()] = val;
+  // Member lookup that only allocates when the key has to be created
+  static value &member(value::object_type &obj, std::string_view key)
+  {
+    auto it = obj.find(key);
+    if (it == obj.end())
+      it = obj.emplace(std::string(key), value{}).first;
+    return it->second;
   }
 
-  std::expected<size_t, std::string> value::push(std::string path, const value &val)
+  void value::set_nested(const std::string &path, const value &val)
   {
-    if (path.empty())
-      return std::unexpected("Path cannot be empty");
+    auto compiled = path::compile(path);
+    if (!compiled)
+      throw std::invalid_argument(compiled.error());
 
-    // Parse the path into tokens
-    std::vector<std::pair<bool, std::string>> tokens;  // pair of (is_array_access, key/index)
+    set_nested(compiled->view(), val);
+  }
 
-    size_t pos = 0;
-    std::string current_token;
+  void value::set_nested(path_view path, const value &val)
+  {
+    if (path.empty())
+      throw std::invalid_argument("Path cannot be empty");
 
-    while (pos < path.size())
+    value *current = this;
+    for (const auto &token : path)
     {
-      if (path[pos] == '.')
-      {
-        // End of an object property
-        if (!current_token.empty())
-        {
-          tokens.push_back({false, current_token});
-          current_token.clear();
-        }
-        pos++;
-      }
-      else if (path[pos] == '[')
+      if (token.is_index)
       {
-        // Start of an array index
-        if (!current_token.empty())
-        {
-          tokens.push_back({false, current_token});
-          current_token.clear();
-        }
-
-        // Extract the index
-        size_t close_bracket = path.find(']', pos);
-        if (close_bracket == std::string::npos)
-          return std::unexpected("Unclosed bracket in path: " + path);
-
-        std::string index_str = path.substr(pos + 1, close_bracket - pos - 1);
-
-        // Validate that index is numeric
-        if (index_str.empty() || !std::all_of(index_str.begin(), index_str.end(), [](char c) { return std::isdigit(c); }))
-          return std::unexpected("Invalid array index '" + index_str + "' in path: " + path);
-
-        tokens.push_back({true, index_str});
-        pos = close_bracket + 1;
+        // Anything that isn't already an array on the way is replaced by one
+        if (!current->is_array())
+          current->data = array_type{};
 
-        // Skip the dot after the bracket if present
-        if (pos < path.size() && path[pos] == '.')
-          pos++;
+        auto &arr = std::get<array_type>(current->data);
+        if (token.index >= arr.size())
+          arr.resize(token.index + 1);
+        current = &arr[token.index];
       }
       else
       {
-        // Part of a property name
-        current_token += path[pos++];
+        // Same for objects
+        if (!current->is_object())
+          current->data = object_type{};
+        current = &member(std::get<object_type>(current->data), token.key);
       }
     }
 
-    // Add the last token if there is one
-    if (!current_token.empty())
-      tokens.push_back({false, current_token});
+    *current = val;
+  }
+
+  std::expected<size_t, std::string> value::push(std::string path, const value &val)
+  {
+    auto compiled = path::compile(path);
+    if (!compiled)
+      return std::unexpected(compiled.error());
+
+    return push(compiled->view(), val);
+  }
 
-    if (tokens.empty())
-      return std::unexpected("Invalid path format");
+  std::expected<size_t, std::string> value::push(path_view path, const value &val)
+  {
+    if (path.empty())
+      return std::unexpected("Path cannot be empty");
 
     // Navigate through the nested structure
     value *current = this;
 
     // Traverse the path to find the target array
-    for (const auto &[is_array_access, token] : tokens)
+    for (const auto &token : path)
     {
-      if (is_array_access)
+      if (token.is_index)
       {
-        // Handle array access
+        // Auto-convert to array if needed
         if (!current->is_array())
-        {
-          // Auto-convert to array if needed
           current->data = array_type{};
-        }
 
         auto &arr = std::get<array_type>(current->data);
-        size_t index = std::stoull(token);
 
         // Resize array if needed
-        if (index >= arr.size())
-          arr.resize(index + 1);
+        if (token.index >= arr.size())
+          arr.resize(token.index + 1);
 
-        current = &arr[index];
+        current = &arr[token.index];
       }
       else
       {
-        // Handle object access
+        // Auto-convert to object if needed
         if (!current->is_object())
-        {
-          // Auto-convert to object if needed
           current->data = object_type{};
-        }
-
-        auto &obj = std::get<object_type>(current->data);
-
-        // Create key if it doesn't exist
-        if (obj.find(token) == obj.end())
-          obj[token] = value{};
 
-        current = &obj[token];
+        current = &member(std::get<object_type>(current->data), token.key);
       }
     }
 
     // Once we've reached the target, ensure it's an array and push the value
     if (!current->is_array())
-    {
-      // Convert to array if needed
       current->data = array_type{};
-    }
 
     auto &arr = std::get<array_type>(current->data);
     arr.push_back(val);
@@ -509,106 +535,66 @@ namespace jsn
   }
 
   std::expected<size_t, std::string> value::put_at(std::string path, const value &val)
+  {
+    auto compiled = path::compile(path);
+    if (!compiled)
+      return std::unexpected(compiled.error());
+
+    return put_at(compiled->view(), val);
+  }
+
+  std::expected<size_t, std::string> value::put_at(path_view path, const value &val)
   {
     if (path.empty())
       return std::unexpected(std::format("Path cannot be empty"));
-    if (path.back() != ']')
+    if (!path.back().is_index)
       return std::unexpected(std::format("Path must end with an array index"));
 
-    std::vector<std::pair<bool, std::string>> tokens;
-    size_t pos = 0;
-    std::string current_token;
-
-    while (pos < path.size())
-    {
-      if (path[pos] == '.')
-      {
-        if (!current_token.empty())
-        {
-          tokens.emplace_back(false, current_token);
-          current_token.clear();
-        }
-        pos++;
-      }
-      else if (path[pos] == '[')
-      {
-        if (!current_token.empty())
-        {
-          tokens.emplace_back(false, current_token);
-          current_token.clear();
-        }
-
-        size_t close_bracket = path.find(']', pos);
-        if (close_bracket == std::string::npos)
-          return std::unexpected(std::format("Unclosed '[' in path: {}", path));
-
-        std::string index_str = path.substr(pos + 1, close_bracket - pos - 1);
-        if (index_str.empty() || !std::all_of(index_str.begin(), index_str.end(), ::isdigit))
-          return std::unexpected(std::format("Invalid array index '{}' in path: {}", index_str, path));
-
-        tokens.emplace_back(true, index_str);
-        pos = close_bracket + 1;
-
-        if (pos < path.size() && path[pos] == '.')
-          pos++;
-      }
-      else
-      {
-        current_token += path[pos++];
-      }
-    }
-
-    if (!current_token.empty())
-      return std::unexpected(std::format("Invalid trailing property in path: {}", current_token));
-
     value *current = this;
 
-    for (size_t i = 0; i < tokens.size(); ++i)
+    for (size_t i = 0; i < path.size(); ++i)
     {
-      const auto &[is_array, key] = tokens[i];
-      bool is_last = (i == tokens.size() - 1);
+      const auto &token = path[i];
+      bool is_last = (i == path.size() - 1);
 
-      if (is_array)
+      if (token.is_index)
       {
-        size_t index = std::stoull(key);
-
         if (!current->is_array())
         {
           if (!current->is_null())
-            return std::unexpected(std::format("Expected array at index [{}] but found {}", key, type_to_string(current->type())));
+            return std::unexpected(std::format("Expected array at index [{}] but found {}", token.index, type_to_string(current->type())));
           current->data = array_type{};
         }
 
         auto &arr = std::get<array_type>(current->data);
-        if (index >= arr.size())
-          arr.resize(index + 1);
+        if (token.index >= arr.size())
+          arr.resize(token.index + 1);
 
         if (is_last)
         {
-          arr[index] = val;
-          return index;
+          arr[token.index] = val;
+          return token.index;
         }
 
-        current = &arr[index];
+        current = &arr[token.index];
       }
       else
       {
         if (!current->is_object())
         {
           if (!current->is_null())
-            return std::unexpected(std::format("Expected object at '{}' but found {}", key, type_to_string(current->type())));
+            return std::unexpected(std::format("Expected object at '{}' but found {}", token.key, type_to_string(current->type())));
           current->data = object_type{};
         }
 
-        auto &obj = std::get<object_type>(current->data);
-        current = &obj[key];
+        current = &member(std::get<object_type>(current->data), token.key);
       }
     }
 
     return std::unexpected("Invalid path or unexpected failure.");
   }
 
-  inline json_location compute_location(std::string_view input, size_t pos, const std::string &filename)
+  json_location compute_location(std::string_view input, size_t pos, const std::string &filename)
   {
     json_location loc;
     loc.position = pos;
@@ -754,6 +740,10 @@ namespace jsn
             throw make_error(std::format("Invalid escape sequence '\\{}'", input[pos]));
         }
       }
+      else if (static_cast<unsigned char>(input[pos]) < 0x20)
+      {
+        throw make_error("Unescaped control character in string");
+      }
       else
       {
         result.push_back(input[pos]);
@@ -989,6 +979,12 @@ namespace jsn
     return result;
   }
 
+  value parser::parse_at(std::size_t offset)
+  {
+    pos = offset;
+    return parse_value();
+  }
+
   std::expected<value, parse_error> parser::try_parse(std::string_view json_str, std::string filename) noexcept
   {
     try
@@ -1011,116 +1007,207 @@ namespace jsn
 
   std::expected<value, parse_error> try_parse(std::string_view json_str) noexcept { return parser::try_parse(json_str); }
 
+  writer::writer(int fd, std::size_t capacity) : fd(fd), capacity(capacity == 0 ? 1 : capacity) { buffer.reserve(this->capacity); }
+
+  void writer::write(std::string_view s)
+  {
+    if (fd >= 0 && s.size() >= capacity)
+    {
+      // Large pieces go straight to the descriptor instead of being copied through the buffer
+      if (flush())
+        write_all(s);
+      return;
+    }
+
+    buffer.append(s);
+    maybe_flush();
+  }
+
+  void writer::write_all(std::string_view s) noexcept
+  {
+    std::size_t done = 0;
+    while (error == 0 && done < s.size())
+    {
+      ssize_t n = ::write(fd, s.data() + done, s.size() - done);
+      if (n >= 0)
+        done += static_cast<std::size_t>(n);
+      else if (errno != EINTR)
+        error = errno;
+    }
+  }
+
+  bool writer::flush() noexcept
+  {
+    if (fd < 0)
+      return true;
+
+    write_all(buffer);
+    buffer.clear();
+    return error == 0;
+  }
+
   // Pretty printer for JSON values
-  std::string pretty_printer::indent(int level) const { return std::string(level * indent_size, ' '); }
+  void pretty_printer::indent(writer &out, int level) const
+  {
+    if (indent_size > 0)
+      out.fill(' ', static_cast<std::size_t>(level * indent_size));
+  }
 
-  std::string pretty_printer::print_internal(const value &v, int level) const
+  // An indent of 0 prints everything on one line
+  void pretty_printer::newline(writer &out) const
+  {
+    if (indent_size > 0)
+      out.put('\n');
+  }
+
+  void pretty_printer::print_internal(writer &out, const value &v, int level) const
   {
     switch (v.type())
     {
       case Value_type::null:
-        return "null";
+        return out.write("null");
 
       case Value_type::boolean:
-        return v.as_boolean() ? "true" : "false";
+        return out.write(v.as_boolean() ? "true" : "false");
 
       case Value_type::number:
-        return std::format("{}", v.as_number());
+        return print_number(out, v.as_number());
 
       case Value_type::string:
-        return std::format("\"{}\"", escape_string(v.as_string()));
+        return print_string(out, v.as_string());
 
       case Value_type::array:
       {
         const auto &arr = v.as_array();
         if (arr.empty())
-          return "[]";
+          return out.write("[]");
 
-        std::string result = "[\n";
+        out.put('[');
+        newline(out);
         for (size_t i = 0; i < arr.size(); ++i)
         {
-          result += indent(level + 1) + print_internal(arr[i], level + 1);
+          indent(out, level + 1);
+          print_internal(out, arr[i], level + 1);
           if (i < arr.size() - 1)
-            result += ",";
-          result += "\n";
+            out.put(',');
+          newline(out);
         }
-        result += indent(level) + "]";
-        return result;
+        indent(out, level);
+        return out.put(']');
       }
 
       case Value_type::object:
       {
         const auto &obj = v.as_object();
         if (obj.empty())
-          return "{}";
+          return out.write("{}");
 
-        std::string result = "{\n";
+        out.put('{');
+        newline(out);
         size_t i = 0;
         for (const auto &[key, value] : obj)
         {
-          result += indent(level + 1) + std::format("\"{}\": {}", key, print_internal(value, level + 1));
+          indent(out, level + 1);
+          print_string(out, key);
+          out.write(indent_size > 0 ? ": " : ":");
+          print_internal(out, value, level + 1);
           if (i < obj.size() - 1)
-            result += ",";
-          result += "\n";
+            out.put(',');
+          newline(out);
           i++;
         }
-        result += indent(level) + "}";
-        return result;
+        indent(out, level);
+        return out.put('}');
       }
 
       default:
-        return "";  // Should never happen
+        return;  // Should never happen
     }
   }
 
-  std::string pretty_printer::escape_string(const std::string &s) const
+  void pretty_printer::print_number(writer &out, double num) const
   {
-    std::string result;
-    result.reserve(s.size());
+    // Shortest representation that round-trips, same output as std::format("{}")
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), num);
+    if (ec != std::errc())
+      return out.write("null");
+    out.write(std::string_view(buf, end - buf));
+  }
+
+  // Index of the first byte that needs escaping ('"', '\\' or a control character), or s.size()
+  static std::size_t find_escape(std::string_view s, std::size_t from)
+  {
+    std::size_t i = from;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= s.size(); i += 16)
+    {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+      __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                  _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+      if (int mask = _mm_movemask_epi8(hits))
+        return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < s.size(); ++i)
+    {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      if (c == '"' || c == '\\' || c < 0x20)
+        return i;
+    }
+    return s.size();
+  }
+
+  void pretty_printer::print_string(writer &out, std::string_view s) const
+  {
+    static constexpr char hex[] = "0123456789abcdef";
 
-    for (char c : s)
+    out.put('"');
+    std::size_t pos = 0;
+    while (pos < s.size())
     {
+      std::size_t next = find_escape(s, pos);
+      out.write(s.substr(pos, next - pos));
+      if (next == s.size())
+        break;
+
+      unsigned char c = static_cast<unsigned char>(s[next]);
       switch (c)
       {
-        case '\"':
-          result += "\\\"";
-          break;
-        case '\\':
-          result += "\\\\";
-          break;
-        case '\b':
-          result += "\\b";
-          break;
-        case '\f':
-          result += "\\f";
-          break;
-        case '\n':
-          result += "\\n";
-          break;
-        case '\r':
-          result += "\\r";
-          break;
-        case '\t':
-          result += "\\t";
-          break;
+        case '\"': out.write("\\\""); break;
+        case '\\': out.write("\\\\"); break;
+        case '\b': out.write("\\b"); break;
+        case '\f': out.write("\\f"); break;
+        case '\n': out.write("\\n"); break;
+        case '\r': out.write("\\r"); break;
+        case '\t': out.write("\\t"); break;
         default:
-          if (static_cast<unsigned char>(c) < 32)
-            result += std::format("\\u{:04x}", static_cast<unsigned int>(c));
-          else
-            result.push_back(c);
+          out.write("\\u00");
+          out.put(hex[c >> 4]);
+          out.put(hex[c & 0xF]);
       }
+      pos = next + 1;
     }
-
-    return result;
+    out.put('"');
   }
 
   pretty_printer::pretty_printer(const value &v, int indent) : val(v), indent_size(indent) {}
 
-  std::string pretty_printer::to_string() const { return print_internal(val, 0); }
+  std::string pretty_printer::to_string() const
+  {
+    writer out;
+    write_to(out);
+    return out.take();
+  }
+
+  void pretty_printer::write_to(writer &out) const { print_internal(out, val, 0); }
 
   std::string to_string(const value &v)
   {
-    pretty_printer printer(v, 0);  // No indentation for compact output
+    pretty_printer printer(v, 0);  // Single line, compact output
     return printer.to_string();
   }
 
@@ -1131,5 +1218,5 @@ namespace jsn
   }
 
   using array_type = std::vector<value>;
-  using object_type = std::map<std::string, value>;
+  using object_type = std::map<std::string, value, std::less<>>;
 }  // namespace jsn
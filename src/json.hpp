@@ -9,6 +9,7 @@
  */
 
 #include <cstdio>
+#include <limits>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -17,16 +18,106 @@
 #include <stdexcept>
 #include <expected>
 #include <optional>
+#include <memory>
+#include <span>
 
 namespace jsn
 {
   enum class Value_type { null, boolean, number, string, array, object };
 
+  // One step of a path like "todos[2].done": a member name or an array index
+  struct path_token
+  {
+    std::string_view key;
+    std::size_t index = 0;
+    bool is_index = false;
+  };
+
+  using path_view = std::span<const path_token>;
+
+  // Splits a path into tokens, calling `emit` for each one. Returns an error message, empty on success.
+  // Dots separate member names, "[n]" is an array index and empty names are skipped.
+  template <typename Emit>
+  constexpr std::string_view tokenize_path(std::string_view path, Emit &&emit)
+  {
+    if (path.empty())
+      return "Path cannot be empty";
+
+    std::size_t pos = 0, key_start = 0;
+    while (pos < path.size())
+    {
+      if (path[pos] == '.')
+      {
+        if (pos > key_start)
+          emit(path_token{path.substr(key_start, pos - key_start)});
+        key_start = ++pos;
+      }
+      else if (path[pos] == '[')
+      {
+        if (pos > key_start)
+          emit(path_token{path.substr(key_start, pos - key_start)});
+
+        std::size_t close_bracket = path.find(']', pos);
+        if (close_bracket == std::string_view::npos)
+          return "Unclosed '[' in path";
+        if (close_bracket == pos + 1)
+          return "Invalid array index in path";
+
+        std::size_t index = 0;
+        for (std::size_t i = pos + 1; i < close_bracket; ++i)
+        {
+          if (path[i] < '0' || path[i] > '9')
+            return "Invalid array index in path";
+          const auto digit = static_cast<std::size_t>(path[i] - '0');
+          if (index > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+            return "Array index out of range in path";
+          index = index * 10 + digit;
+        }
+        emit(path_token{{}, index, true});
+
+        pos = close_bracket + 1;
+        if (pos < path.size() && path[pos] == '.')
+          pos++;
+        key_start = pos;
+      }
+      else
+        pos++;
+    }
+
+    if (pos > key_start)
+      emit(path_token{path.substr(key_start, pos - key_start)});
+    return {};
+  }
+
+  // A path compiled once at runtime, reusable for any number of lookups or updates without re-parsing
+  class path
+  {
+  private:
+    std::unique_ptr<char[]> source;
+    std::size_t length = 0;
+    std::vector<path_token> tokens;
+
+    path() = default;
+
+  public:
+    [[nodiscard]] static std::expected<path, std::string> compile(std::string_view str);
+
+    path(const path &other);
+    path(path &&other) noexcept;
+    path &operator=(const path &other);
+    path &operator=(path &&other) noexcept;
+
+    [[nodiscard]] std::string_view str() const noexcept { return {source.get(), length}; }
+    [[nodiscard]] path_view view() const noexcept { return tokens; }
+    operator path_view() const noexcept { return tokens; }
+  };
+
   class value
   {
   public:
     using array_type  = std::vector<value>;
-    using object_type = std::map<std::string, value>;
+    using object_type = std::map<std::string, value, std::less<>>;
+    using array_view  = std::span<const value>;
 
   private:
     using json_variant = std::variant<std::monostate,  // > Represents null
@@ -110,10 +201,11 @@ namespace jsn
     [[nodiscard]] array_type &ref_array();
     [[nodiscard]] object_type &ref_object();
 
-    [[nodiscard]] const value operator[](const std::size_t index) const;
-    [[nodiscard]] const value operator[](int index) const;
-    [[nodiscard]] const value operator[](const char *key) const;
-    [[nodiscard]] const value operator[](const std::string &key) const;
+    // Missing members and out of range indices read as a shared null value
+    [[nodiscard]] const value &operator[](const std::size_t index) const;
+    [[nodiscard]] const value &operator[](int index) const;
+    [[nodiscard]] const value &operator[](const char *key) const;
+    [[nodiscard]] const value &operator[](const std::string &key) const;
 
     value &operator[](std::size_t index);
     value &operator[](int index);
@@ -132,11 +224,28 @@ namespace jsn
     [[nodiscard]] std::optional<array_type> array_opt() const noexcept;
     [[nodiscard]] std::optional<object_type> object_opt() const noexcept;
 
+    // Non-copying access: pointers/views into this value, null/nullopt on a type mismatch or missing member
+    [[nodiscard]] const value *find(std::string_view key) const noexcept;
+    [[nodiscard]] value *find(std::string_view key) noexcept;
+    [[nodiscard]] const value *find(std::size_t index) const noexcept;
+    [[nodiscard]] std::optional<std::string_view> string_view_opt() const noexcept;
+    [[nodiscard]] std::optional<array_view> array_view_opt() const noexcept;
+
+    template <typename T>
+    [[nodiscard]] const T *get_if() const noexcept { return std::get_if<T>(&data); }
+
+    template <typename T>
+    [[nodiscard]] T *get_if() noexcept { return std::get_if<T>(&data); }
+
     object_type& mut_object();
     void set(const std::string &key, const value &val);
+    // String paths are compiled on every call, use a jsn::path when updating in a loop
     void set_nested(const std::string &path, const value &val);
+    void set_nested(path_view path, const value &val);
     std::expected<size_t, std::string> push(std::string path, const value &val);
+    std::expected<size_t, std::string> push(path_view path, const value &val);
     std::expected<size_t, std::string> put_at(std::string path, const value &val);
+    std::expected<size_t, std::string> put_at(path_view path, const value &val);
 
     bool exists(const std::string &key)
     {
@@ -186,7 +295,7 @@ namespace jsn
   };
 
   using array_type = std::vector<value>;
-  using object_type = std::map<std::string, value>;
+  using object_type = std::map<std::string, value, std::less<>>;
 
   struct json_location
   {
@@ -236,6 +345,8 @@ namespace jsn
   public:
     explicit parser(std::string_view json_str);
     [[nodiscard]] value parse();
+    // Parse the single value starting at `offset` and leave the rest of the input untouched
+    [[nodiscard]] value parse_at(std::size_t offset);
 
     [[nodiscard]] static std::expected<value, parse_error> try_parse(std::string_view json_str,
                                                                     std::string filename = "<config file>") noexcept;
@@ -244,19 +355,66 @@ namespace jsn
   [[nodiscard]] value parse(std::string_view json_str);
   [[nodiscard]] std::expected<value, parse_error> try_parse(std::string_view json_str) noexcept;
 
+  // Output buffer for the serializer, every node is appended in place so printing is linear in the output size.
+  // Constructed with a file descriptor it becomes a fixed-size buffer that is flushed to the descriptor whenever it
+  // fills up, so serialising a large document needs no more memory than the buffer itself.
+  class writer
+  {
+  private:
+    std::string buffer;
+    int fd = -1;
+    std::size_t capacity = 0;
+    int error = 0;
+
+    void write_all(std::string_view s) noexcept;
+    void maybe_flush()
+    {
+      if (fd >= 0 && buffer.size() >= capacity)
+        (void)flush();
+    }
+
+  public:
+    writer() = default;
+    explicit writer(std::size_t reserve) { buffer.reserve(reserve); }
+    writer(int fd, std::size_t capacity);
+
+    void put(char c)
+    {
+      buffer.push_back(c);
+      maybe_flush();
+    }
+    void write(std::string_view s);
+    void fill(char c, std::size_t count)
+    {
+      buffer.append(count, c);
+      maybe_flush();
+    }
+
+    // Write out whatever is buffered, false once any write to the descriptor has failed
+    [[nodiscard]] bool flush() noexcept;
+    // errno of the first failed write, 0 if none
+    [[nodiscard]] int last_error() const noexcept { return error; }
+
+    [[nodiscard]] const std::string &str() const noexcept { return buffer; }
+    [[nodiscard]] std::string take() noexcept { return std::move(buffer); }
+  };
+
   class pretty_printer
   {
   private:
     const value &val;
     int indent_size;
 
-    [[nodiscard]] std::string indent(int level) const;
-    [[nodiscard]] std::string print_internal(const value &v, int level) const;
-    [[nodiscard]] std::string escape_string(const std::string &s) const;
+    void indent(writer &out, int level) const;
+    void newline(writer &out) const;
+    void print_internal(writer &out, const value &v, int level) const;
+    void print_number(writer &out, double num) const;
+    void print_string(writer &out, std::string_view s) const;
 
   public:
     explicit pretty_printer(const value &v, int indent = 2);
     [[nodiscard]] std::string to_string() const;
+    void write_to(writer &out) const;
   };
 
   [[nodiscard]] std::string to_string(const value &v);
@@ -0,0 +1,192 @@
+#include "./json_lazy.hpp"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace jsn
+{
+  static constexpr std::size_t npos = std::string_view::npos;
+
+  static std::size_t skip_whitespace(std::string_view s, std::size_t pos)
+  {
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\n' || s[pos] == '\t' || s[pos] == '\r')) pos++;
+    return pos;
+  }
+
+  // `pos` is at the opening quote, returns one past the closing quote
+  static std::size_t skip_string(std::string_view s, std::size_t pos)
+  {
+    pos++;
+    while (true)
+    {
+      pos = s.find_first_of("\"\\", pos);
+      if (pos == npos)
+        return npos;
+      if (s[pos] == '"')
+        return pos + 1;
+      pos += 2;
+    }
+  }
+
+  // Structural skip only: brackets are balanced and strings closed, everything else is left to the real parser
+  static std::size_t skip_value(std::string_view s, std::size_t pos)
+  {
+    std::size_t depth = 0;
+    do
+    {
+      pos = skip_whitespace(s, pos);
+      if (pos >= s.size())
+        return npos;
+
+      switch (s[pos])
+      {
+        case '"':
+          pos = skip_string(s, pos);
+          if (pos == npos)
+            return npos;
+          break;
+        case '{':
+        case '[':
+          depth++;
+          pos++;
+          break;
+        case '}':
+        case ']':
+          if (depth == 0)
+            return npos;
+          depth--;
+          pos++;
+          break;
+        case ',':
+        case ':':
+          if (depth == 0)
+            return npos;
+          pos++;
+          break;
+        default:
+          while (pos < s.size() && !std::strchr(",:{}[]\" \t\r\n", s[pos])) pos++;
+          break;
+      }
+    } while (depth > 0);
+
+    return pos;
+  }
+
+  lazy_document::lazy_document(std::string json_text, std::string filename) : text(std::move(json_text)), filename(std::move(filename))
+  {
+    build_index();
+  }
+
+  void lazy_document::build_index()
+  {
+    const std::string_view s = text;
+
+    // Anything the structural scan doesn't like gets a full parse, which produces the proper error
+    auto fail = [&]()
+    {
+      parser p(text);
+      p.filename = filename;
+      if (!p.parse().is_object())
+        throw parse_error("Expected object at top level", compute_location(s, 0, filename), s.substr(0, s.find('\n')));
+      throw parse_error("Malformed document", compute_location(s, 0, filename), "");
+    };
+
+    std::size_t pos = skip_whitespace(s, 0);
+    if (pos >= s.size() || s[pos] != '{')
+      fail();
+    pos = skip_whitespace(s, pos + 1);
+
+    if (pos < s.size() && s[pos] == '}')
+    {
+      if (skip_whitespace(s, pos + 1) != s.size())
+        fail();
+      return;
+    }
+
+    while (true)
+    {
+      if (pos >= s.size() || s[pos] != '"')
+        fail();
+
+      std::size_t key_end = skip_string(s, pos);
+      if (key_end == npos)
+        fail();
+
+      std::string key;
+      std::string_view raw = s.substr(pos + 1, key_end - pos - 2);
+      if (raw.find('\\') == npos)
+        key = raw;
+      else
+      {
+        parser p(text);
+        p.filename = filename;
+        key = p.parse_at(pos).as_string();
+      }
+
+      pos = skip_whitespace(s, key_end);
+      if (pos >= s.size() || s[pos] != ':')
+        fail();
+
+      std::size_t begin = skip_whitespace(s, pos + 1);
+      std::size_t end = skip_value(s, begin);
+      if (end == npos)
+        fail();
+
+      members[std::move(key)] = member{begin, end, std::nullopt};
+
+      pos = skip_whitespace(s, end);
+      if (pos < s.size() && s[pos] == ',')
+      {
+        pos = skip_whitespace(s, pos + 1);
+        continue;
+      }
+      if (pos < s.size() && s[pos] == '}')
+        break;
+      fail();
+    }
+
+    if (skip_whitespace(s, pos + 1) != s.size())
+      fail();
+  }
+
+  std::expected<lazy_document, parse_error> lazy_document::try_load(std::string json_text, std::string filename) noexcept
+  {
+    try
+    {
+      return lazy_document(std::move(json_text), std::move(filename));
+    }
+    catch (const parse_error &e)
+    {
+      return std::unexpected(e);
+    }
+  }
+
+  bool lazy_document::contains(std::string_view key) const noexcept { return members.find(key) != members.end(); }
+
+  const value &lazy_document::operator[](std::string_view key) const
+  {
+    static const value null_value;
+
+    auto it = members.find(key);
+    if (it == members.end())
+      return null_value;
+
+    const member &m = it->second;
+    if (!m.cached)
+    {
+      parser p(text);
+      p.filename = filename;
+      m.cached = p.parse_at(m.begin);
+    }
+    return *m.cached;
+  }
+
+  value lazy_document::to_value() const
+  {
+    value::object_type obj;
+    for (const auto &[key, m] : members) obj[key] = (*this)[key];
+    return value(std::move(obj));
+  }
+}  // namespace jsn
@@ -0,0 +1,54 @@
+#pragma once
+
+/* On-demand access to a JSON object document
+ *
+ * NOTE: Only the top level of the document is indexed up front (member name -> byte range). A member's value is
+ *  parsed the first time it is looked up and cached, so a command that touches `files` never pays for `todos`.
+ *  Malformed members are only reported when they are touched.
+ */
+
+#include <cstddef>
+#include <expected>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "./json.hpp"
+
+namespace jsn
+{
+  class lazy_document
+  {
+  private:
+    struct member
+    {
+      std::size_t begin = 0;
+      std::size_t end = 0;
+      mutable std::optional<value> cached;
+    };
+
+    std::string text;
+    std::map<std::string, member, std::less<>> members;
+
+    void build_index();
+
+  public:
+    std::string filename = "<unknown>";
+
+    lazy_document() = default;
+    explicit lazy_document(std::string json_text, std::string filename = "<unknown>");
+
+    [[nodiscard]] static std::expected<lazy_document, parse_error> try_load(std::string json_text,
+                                                                            std::string filename = "<unknown>") noexcept;
+
+    [[nodiscard]] bool contains(std::string_view key) const noexcept;
+    [[nodiscard]] std::size_t size() const noexcept { return members.size(); }
+
+    // Materialises the member on first access; missing members read as null.
+    [[nodiscard]] const value &operator[](std::string_view key) const;
+
+    // Materialises everything, for callers that need the full DOM after all.
+    [[nodiscard]] value to_value() const;
+  };
+}  // namespace jsn
@@ -0,0 +1,410 @@
+#include "./json_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace jsn
+{
+  std::size_t fd_source::read(char *buf, std::size_t size)
+  {
+    while (true)
+    {
+      ssize_t n = ::read(fd, buf, size);
+      if (n >= 0)
+        return static_cast<std::size_t>(n);
+      if (errno != EINTR)
+        throw std::system_error(errno, std::generic_category(), "read");
+    }
+  }
+
+  std::size_t string_source::read(char *buf, std::size_t size)
+  {
+    std::size_t n = std::min(size, input.size() - pos);
+    std::memcpy(buf, input.data() + pos, n);
+    pos += n;
+    return n;
+  }
+
+  reader::reader(source &src, std::size_t chunk_size) : src(src), buffer(chunk_size == 0 ? 1 : chunk_size) {}
+
+  bool reader::refill()
+  {
+    if (eof)
+      return false;
+
+    len = src.read(buffer.data(), buffer.size());
+    pos = 0;
+    if (len == 0)
+      eof = true;
+    return len > 0;
+  }
+
+  int reader::peek()
+  {
+    if (pos == len && !refill())
+      return -1;
+    return static_cast<unsigned char>(buffer[pos]);
+  }
+
+  char reader::take()
+  {
+    if (peek() < 0)
+      throw make_error("Unexpected end of input");
+
+    char c = buffer[pos++];
+    consumed++;
+    if (c == '\n')
+    {
+      line++;
+      column = 1;
+    }
+    else
+      column++;
+    return c;
+  }
+
+  void reader::expect(char c, std::string_view what)
+  {
+    if (peek() != static_cast<unsigned char>(c))
+      throw make_error(std::format("Expected {}", what));
+    take();
+  }
+
+  void reader::skip_whitespace()
+  {
+    for (int c = peek(); c == ' ' || c == '\n' || c == '\t' || c == '\r'; c = peek())
+      take();
+  }
+
+  parse_error reader::make_error(const std::string &message) const
+  {
+    json_location loc;
+    loc.position = consumed;
+    loc.line = line;
+    loc.column = column;
+    loc.filename = filename;
+
+    // Only the unread part of the current chunk is still around, use it as context
+    std::string_view rest(buffer.data() + pos, len - pos);
+    rest = rest.substr(0, rest.find('\n'));
+    return parse_error(message, loc, rest.substr(0, 40));
+  }
+
+  static void append_utf8(std::string &out, std::uint32_t cp)
+  {
+    if (cp < 0x80)
+      out.push_back(static_cast<char>(cp));
+    else if (cp < 0x800)
+    {
+      out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+      out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+      out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  void reader::read_string()
+  {
+    expect('"', "string");
+    token.clear();
+
+    auto read_hex4 = [&]() -> std::uint32_t
+    {
+      std::uint32_t cp = 0;
+      for (int i = 0; i < 4; ++i)
+      {
+        char h = take();
+        cp <<= 4;
+        if (h >= '0' && h <= '9')
+          cp |= h - '0';
+        else if (h >= 'a' && h <= 'f')
+          cp |= h - 'a' + 10;
+        else if (h >= 'A' && h <= 'F')
+          cp |= h - 'A' + 10;
+        else
+          throw make_error("Invalid Unicode escape sequence");
+      }
+      return cp;
+    };
+
+    while (true)
+    {
+      // Copy runs of plain characters straight out of the chunk
+      if (pos == len && !refill())
+        throw make_error("Unterminated string");
+
+      std::size_t run = pos;
+      while (run < len && buffer[run] != '"' && buffer[run] != '\\' && static_cast<unsigned char>(buffer[run]) >= 0x20) run++;
+      token.append(buffer.data() + pos, run - pos);
+      column += run - pos;
+      consumed += run - pos;
+      pos = run;
+
+      if (pos == len)
+        continue;
+
+      char c = take();
+      if (c == '"')
+        return;
+      if (c != '\\')
+        throw make_error("Unescaped control character in string");
+
+      switch (take())
+      {
+        case '"': token.push_back('"'); break;
+        case '\\': token.push_back('\\'); break;
+        case '/': token.push_back('/'); break;
+        case 'b': token.push_back('\b'); break;
+        case 'f': token.push_back('\f'); break;
+        case 'n': token.push_back('\n'); break;
+        case 'r': token.push_back('\r'); break;
+        case 't': token.push_back('\t'); break;
+        case 'u':
+        {
+          std::uint32_t cp = read_hex4();
+          if (cp >= 0xD800 && cp <= 0xDBFF)
+          {
+            if (take() != '\\' || take() != 'u')
+              throw make_error("Unpaired surrogate in Unicode escape");
+            std::uint32_t low = read_hex4();
+            if (low < 0xDC00 || low > 0xDFFF)
+              throw make_error("Invalid low surrogate in Unicode escape");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          }
+          append_utf8(token, cp);
+          break;
+        }
+        default:
+          throw make_error("Invalid escape sequence");
+      }
+    }
+  }
+
+  void reader::read_number()
+  {
+    token.clear();
+    auto is_digit = [](int c) { return c >= '0' && c <= '9'; };
+    auto digits = [&]()
+    {
+      if (!is_digit(peek()))
+        throw make_error("Invalid number");
+      while (is_digit(peek())) token.push_back(take());
+    };
+
+    if (peek() == '-')
+      token.push_back(take());
+
+    if (peek() == '0')
+      token.push_back(take());
+    else
+      digits();
+
+    if (peek() == '.')
+    {
+      token.push_back(take());
+      digits();
+    }
+
+    if (peek() == 'e' || peek() == 'E')
+    {
+      token.push_back(take());
+      if (peek() == '+' || peek() == '-')
+        token.push_back(take());
+      digits();
+    }
+
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), num);
+    if (ec != std::errc() || ptr != token.data() + token.size())
+      throw make_error(std::format("Invalid number: {}", token));
+  }
+
+  void reader::read_literal(std::string_view literal)
+  {
+    for (char c : literal)
+      if (peek() != c)
+        throw make_error(std::format("Expected {}", literal));
+      else
+        take();
+  }
+
+  event reader::read_scalar_or_open()
+  {
+    after_key = false;
+    started = true;
+
+    switch (peek())
+    {
+      case '{':
+        take();
+        stack.push_back('{');
+        need_separator = false;
+        return event::start_object;
+      case '[':
+        take();
+        stack.push_back('[');
+        need_separator = false;
+        return event::start_array;
+      case '"':
+        read_string();
+        need_separator = true;
+        return event::string;
+      case 't':
+        read_literal("true");
+        flag = true;
+        need_separator = true;
+        return event::boolean;
+      case 'f':
+        read_literal("false");
+        flag = false;
+        need_separator = true;
+        return event::boolean;
+      case 'n':
+        read_literal("null");
+        need_separator = true;
+        return event::null;
+      case -1:
+        throw make_error("Unexpected end of input");
+      default:
+        if (peek() == '-' || (peek() >= '0' && peek() <= '9'))
+        {
+          read_number();
+          need_separator = true;
+          return event::number;
+        }
+        throw make_error(std::format("Unexpected character '{}'", static_cast<char>(peek())));
+    }
+  }
+
+  event reader::next()
+  {
+    skip_whitespace();
+
+    if (stack.empty())
+    {
+      if (!started)
+        return read_scalar_or_open();
+
+      if (peek() != -1)
+        throw make_error("Expected end of input");
+      return event::end;
+    }
+
+    const bool in_object = stack.back() == '{';
+
+    if (after_key)
+    {
+      expect(':', "':' in object");
+      skip_whitespace();
+      return read_scalar_or_open();
+    }
+
+    if (peek() == (in_object ? '}' : ']'))
+    {
+      take();
+      stack.pop_back();
+      need_separator = true;
+      return in_object ? event::end_object : event::end_array;
+    }
+
+    if (need_separator)
+    {
+      expect(',', in_object ? "',' in object" : "',' in array");
+      skip_whitespace();
+    }
+
+    if (!in_object)
+      return read_scalar_or_open();
+
+    if (peek() != '"')
+      throw make_error("Expected string key in object");
+    read_string();
+    after_key = true;
+    need_separator = false;
+    return event::key;
+  }
+
+  void reader::skip(event ev)
+  {
+    if (ev != event::start_object && ev != event::start_array)
+      return;
+
+    const std::size_t target = stack.size() - 1;
+    while (stack.size() > target) (void)next();
+  }
+
+  value reader::read_value(event ev)
+  {
+    switch (ev)
+    {
+      case event::start_object:
+      {
+        value::object_type obj;
+        for (event e = next(); e != event::end_object; e = next())
+        {
+          std::string key = token;
+          obj[std::move(key)] = read_value(next());
+        }
+        return value(std::move(obj));
+      }
+      case event::start_array:
+      {
+        value::array_type arr;
+        for (event e = next(); e != event::end_array; e = next()) arr.push_back(read_value(e));
+        return value(std::move(arr));
+      }
+      case event::string:
+        return value(token);
+      case event::number:
+        return value(num);
+      case event::boolean:
+        return value(flag);
+      case event::null:
+        return value();
+      default:
+        throw make_error("Expected value");
+    }
+  }
+
+  std::optional<value> find_member(source &src, std::string_view key, std::size_t chunk_size)
+  {
+    reader r(src, chunk_size);
+    std::optional<value> found;
+    event ev = r.next();
+    if (ev != event::start_object)
+      r.skip(ev);
+    else
+      for (ev = r.next(); ev != event::end_object; ev = r.next())
+      {
+        // The last of duplicate members wins, as with `parse`
+        const bool match = r.text() == key;
+        ev = r.next();
+        if (match)
+          found = r.read_value(ev);
+        else
+          r.skip(ev);
+      }
+
+    (void)r.next();  // Throws on anything after the document
+    return found;
+  }
+}  // namespace jsn
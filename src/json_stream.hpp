@@ -0,0 +1,114 @@
+#pragma once
+
+/* Streaming (SAX / pull) interface for jsn
+ *
+ * NOTE: `jsn::parse` builds the whole DOM. The reader here walks a document as a flat sequence of events pulled from a
+ *  chunked input source, so memory stays bounded by the chunk size, the nesting depth and the longest single string.
+ *  `find_member` builds on it to pull one member out of a document, which is how the journal reads the path of each
+ *  record without building the value it carries (see journal.cpp). Strings are held to the same rules as `parse`:
+ *  control characters have to be escaped.
+ */
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./json.hpp"
+
+namespace jsn
+{
+  // A chunked byte source. `read` fills up to `size` bytes and returns how many were written, 0 at end of input.
+  class source
+  {
+  public:
+    virtual ~source() = default;
+    virtual std::size_t read(char *buf, std::size_t size) = 0;
+  };
+
+  // Reads from a file descriptor the caller owns.
+  class fd_source : public source
+  {
+  private:
+    int fd;
+
+  public:
+    explicit fd_source(int fd) noexcept : fd(fd) {}
+    std::size_t read(char *buf, std::size_t size) override;
+  };
+
+  // Reads from memory, mostly useful to share code paths with in-memory documents.
+  class string_source : public source
+  {
+  private:
+    std::string_view input;
+    std::size_t pos = 0;
+
+  public:
+    explicit string_source(std::string_view input) noexcept : input(input) {}
+    std::size_t read(char *buf, std::size_t size) override;
+  };
+
+  enum class event { start_object, end_object, start_array, end_array, key, string, number, boolean, null, end };
+
+  class reader
+  {
+  private:
+    source &src;
+    std::vector<char> buffer;
+    std::size_t pos = 0;
+    std::size_t len = 0;
+    bool eof = false;
+
+    // Location tracking for error messages
+    std::size_t consumed = 0;
+    std::size_t line = 1;
+    std::size_t column = 1;
+
+    std::vector<char> stack;  // '{' or '[' for every open container
+    bool need_separator = false;
+    bool after_key = false;
+    bool started = false;
+
+    std::string token;
+    double num = 0.0;
+    bool flag = false;
+
+    [[nodiscard]] int peek();
+    char take();
+    void expect(char c, std::string_view what);
+    void skip_whitespace();
+    bool refill();
+
+    void read_string();
+    void read_number();
+    void read_literal(std::string_view literal);
+    [[nodiscard]] event read_scalar_or_open();
+    [[nodiscard]] parse_error make_error(const std::string &message) const;
+
+  public:
+    std::string filename = "<stream>";
+
+    explicit reader(source &src, std::size_t chunk_size = 64 * 1024);
+
+    // Advance to the next event, throws `parse_error` on malformed input.
+    [[nodiscard]] event next();
+
+    // Payload of the last event; `text` is only valid until the next call to `next`.
+    [[nodiscard]] std::string_view text() const noexcept { return token; }
+    [[nodiscard]] double number() const noexcept { return num; }
+    [[nodiscard]] bool boolean() const noexcept { return flag; }
+    [[nodiscard]] std::size_t depth() const noexcept { return stack.size(); }
+
+    // Skip the value introduced by the last event (a whole subtree for start_object / start_array).
+    void skip(event ev);
+
+    // Materialise the value introduced by the last event into a DOM.
+    [[nodiscard]] value read_value(event ev);
+  };
+
+  // The member `key` of the top-level object, materialised on its own: the rest of the document is checked but not
+  // built. Nothing when the document isn't an object or has no such member, throws `parse_error` on malformed input.
+  [[nodiscard]] std::optional<value> find_member(source &src, std::string_view key, std::size_t chunk_size = 64 * 1024);
+}  // namespace jsn
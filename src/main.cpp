@@ -1,24 +1,16 @@
+#include <span>
+#include <string>
 #include <vector>
-#include <print>
 
 #include "./meow.hpp"
+#include "./daemon.hpp"
 
 int main(int argc, char *argv[])
 {
-  try
-  {
-    handle_args(std::vector<std::string>(argv, argv + argc));
-  }
-  catch (const std::exception &e)
-  {
-    std::println(stderr, "[ERROR]: {}", e.what());
-    std::println(stderr, "Send patches please 󰇸 ! but maybe it is a genuine issue");
-    return 1;
-  }
-  catch (...)
-  {
-    std::println(stderr, "[ERROR]: Some weird throw, idk where from? send patches please 󰇸 !");
-    return 1;
-  }
-  return 0;
+  // A running daemon already has everything loaded, and the request is encoded straight from argv
+  if (auto status = meow::daemon::forward(std::span<char *const>(argv, argc)))
+    return *status;
+
+  // The commands take their arguments as strings, they are only copied once the command runs here
+  return run_command(std::vector<std::string>(argv, argv + argc));
 }
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <expected>
@@ -7,86 +9,146 @@
 #include <stdexcept>
 #include <filesystem>
 #include <string>
+#include <string_view>
+
+#include <unistd.h>
 
 #include "./meow.hpp"
 #include "./utils.hpp"
 #include "./procs.hpp"
 #include "./printer.hpp"
 #include "./json.hpp"
-#include "./paths.hpp"
+#include "./context.hpp"
 #include "./prompter.hpp"
 #include "./todo.hpp"
+#include "./snapshot.hpp"
+#include "./index.hpp"
+#include "./journal.hpp"
+#include "./daemon.hpp"
+#include "./commands.hpp"
+#include "./backends.hpp"
+#include "./stats.hpp"
+#include "./render_cache.hpp"
+#include "./filetype.hpp"
+
+static void print_help(const std::vector<std::string> &args);
+static void print_version(const std::vector<std::string> &);
+static void refuse_help(const std::vector<std::string> &args);
+
+// Everything handle_args understands, also looked up by batch for each of its lines. Help is printed in this order.
+static constexpr meow::command_table COMMANDS({
+  {"help",         print_help,          {},                "Show this help message",                          "-h", "General"},
+  {"version",      print_version,       {},                "Show the version information",                    "-v", "General"},
+  {"daemon",       meow::daemon::serve, {},                "Keep config and data loaded and serve other meow invocations", {}, "General"},
+  {"--help",       refuse_help},
+  {"list",         show_all,            {},                "List all the files with their path",              {},   "File commands"},
+  {"open",         open_file,           "<file>[:line]..", "Open files in $EDITOR, optionally at a line",     {},   "File commands"},
+  {"show",         show_file,           "<file|alias>..",  "Cat or bat the files or aliases added to meow",   {},   "File commands"},
+  {"add",          add_file,            "<path>",          "Add a file to meow",                              {},   "File commands"},
+  {"remove",       remove_file,         "<file>",          "Remove a file from meow",                         {},   "File commands"},
+  {"alias",        add_alias,           "<alias> <file>",  "Alias a file name to call it using alias",        {},   "File commands"},
+  {"remove-alias", remove_alias,        "<alias>",         "Remove an alias",                                 {},   "File commands"},
+  {"batch",        run_batch,           "[file|-]",        "Run one command per line from a file or stdin, saved once at the end", {}, "File commands"},
+  {"todo",         meow_todo},
+});
+
+// `todo` subcommands, looked up on args[2]
+static constexpr meow::command_table TODO_COMMANDS({
+  {"add",    meow::todo::add,    "<todo> [dd/mm/yyyy]", "Add a todo, asking for what isn't given", {}, "TODO commands"},
+  {"remove", meow::todo::remove, "<todo no.|name>",     "Remove a todo",                          {}, "TODO commands"},
+  {"toggle", meow::todo::toggle, "<todo no.|name>",     "Mark a todo done or not done",           {}, "TODO commands"},
+  {"list",   meow::todo::list,   {},                    "List the todos",                         {}, "TODO commands"},
+});
+
+static void print_help(const std::vector<std::string> &args)
+{
+  std::println();
+  std::println("Usage: {} [--stats] <command> <args>..", args[0]);
+  meow::print_commands(COMMANDS);
+  meow::print_commands(TODO_COMMANDS, "todo ");
+}
 
-// Lazy-evaluated global config/data paths
-const std::string& CONFIG_PATH() {
-  static const std::string path = paths::config_path();
-  return path;
+static void print_version(const std::vector<std::string> &)
+{
+  std::println("IDK the version system properly!");
 }
 
-const std::string& DATA_PATH() {
-  static const std::string path = paths::data_path();
-  return path;
+static void refuse_help(const std::vector<std::string> &args)
+{
+  std::println(stderr, "Unknown command: ' {} '", args[1]);
+  std::println(stderr, "Yes I know you want help and yes I won't do it. Use 'help' or '-h' instead.");
 }
 
-void handle_args(std::vector<std::string> args)
+// Runs the subcommand named by args[1], false if there is none
+static bool dispatch(const std::vector<std::string> &args)
 {
-  std::size_t NUM_ARGS = args.size() - 1;
+  const meow::command *cmd = COMMANDS.find(args[1]);
+  if (!cmd)
+    return false;
 
-  if (NUM_ARGS == 0)
-    throw std::runtime_error("TODO: Implement default CLI.");
+  cmd->run(args);
+  return true;
+}
 
-  else if (NUM_ARGS >= 1)
+bool runs_detached(std::span<char *const> argv)
+{
+  if (argv.size() < 2)
+    return false;
+
+  const std::string_view cmd = argv[1];
+  if (cmd == "list" || cmd == "remove" || cmd == "alias" || cmd == "remove-alias")
+    return true;
+  if (cmd == "add")
+    return argv.size() == 3;
+  if (cmd == "todo" && argv.size() >= 3)
   {
-    if (args[1] == "help" || args[1] == "-h")
-    {
-      std::println();
-      std::println("Usage: {} [options] <args>..", args[0]);
-      std::println();
-      std::println("  Options without args:");
-      std::println("     help                         Show this help message");
-      std::println("     version                      Show the version information");
-      std::println("     list                         List all the files with their path");
-      std::println();
-      std::println("  Options with args:");
-      std::println();
-      std::println("    --------------------File commands--------------------");
-      std::println();
-      std::println("     open <file>                  Open a file in the default editor");
-      std::println("     show <file|alias>            Cat or bat the file or alias added to meow");
-      std::println("     add <path>                   Add a file to meow");
-      std::println("     remove <file>                Remove a file from meow");
-      std::println("     alias <file|alias>           Alias a file name to call it using alias");
-      std::println("     remove-alias <alias>         Remove an alias");
-      std::println();
-      std::println("    --------------------TODO commands--------------------");
-      std::println();
-      std::println("     todo                          Open todo repl");
-      std::println("     todo add <todo>               Add a todo");
-      std::println("     todo remove <todo no.|name>   Remove a todo");
-      return;
-    }
-    else if (args[1] == "version" || args[1] == "-v")
-    {
-      std::println("IDK the version system properly!");
-      return;
-    }
-    else if (args[1] == "--help")
-    {
-      std::println(stderr, "Unknown command: ' {} '", args[1]);
-      std::println(stderr, "Yes I know you want help and yes I won't do it. Use 'help' or '-h' instead.");
-    }
-    else if (args[1] == "show")         return show_file(args);
-    else if (args[1] == "list")         return show_all(args);
-    else if (args[1] == "add")          return add_file(args);
-    else if (args[1] == "remove")       return remove_file(args);
-    else if (args[1] == "alias")        return add_alias(args);
-    else if (args[1] == "remove-alias") return remove_alias(args);
-    else if (args[1] == "open")         return open_file(args);
-    else if (args[1] == "todo")         return meow_todo(args);
+    const std::string_view sub = argv[2];
+    return sub == "list" || sub == "remove" || sub == "toggle" || (sub == "add" && argv.size() == 5);
   }
+  return false;
+}
+
+int run_command(const std::vector<std::string> &args)
+{
+  // `meow --stats <command>`
+  if (args.size() > 2 && args[1] == "--stats")
+  {
+    meow::stats::print_to_stderr();
+    std::vector<std::string> rest = args;
+    rest.erase(rest.begin() + 1);
+    return run_command(rest);
+  }
+  if (args.size() > 1)
+    meow::stats::set_command(args[1]);
+
+  try
+  {
+    handle_args(args);
+  }
+  catch (const std::exception &e)
+  {
+    std::println(stderr, "[ERROR]: {}", e.what());
+    std::println(stderr, "Send patches please 󰇸 ! but maybe it is a genuine issue");
+    return 1;
+  }
+  catch (...)
+  {
+    std::println(stderr, "[ERROR]: Some weird throw, idk where from? send patches please 󰇸 !");
+    return 1;
+  }
+  return 0;
+}
+
+void handle_args(const std::vector<std::string> &args)
+{
+  if (args.size() < 2)
+    throw std::runtime_error("TODO: Implement default CLI.");
+
+  if (!dispatch(args))
+    std::println(stderr, "Unknown command: ' {} '", args[1]);
 }
 
-void show_all(std::vector<std::string> args)
+void show_all(const std::vector<std::string> &args)
 {
   if (args.size() != 2)
   {
@@ -94,100 +156,129 @@ void show_all(std::vector<std::string> args)
     return;
   }
 
-  jsn::value data;
-  if (!meow::get_json(DATA_PATH(), data))
-    return;
-
-  auto &files = meow::ensure_array(data, "files");
+  const meow::snapshot &data = meow::context::get().data();
 
   std::println("  {:<20} {}", "Name", "Path");
   std::println("{:-<20} {:-<30}", "", "", "");
 
-  for (auto &f : files)
-    std::println("  {:<20} {}",
-      f["name"].string_opt().value_or("<no name>"),
-      f["path"].string_opt().value_or("<no path>")
-    );
+  for (std::size_t i = 0; i < data.file_count(); ++i)
+  {
+    auto [name, path] = data.file(i);
+    std::println("  {:<20} {}", name.empty() ? "<no name>" : name, path.empty() ? "<no path>" : path);
+  }
 }
 // show_file
-void show_file(std::vector<std::string> args)
+void show_file(const std::vector<std::string> &args)
 {
-  if (args.size() != 3)
+  if (args.size() < 3)
   {
-    std::println(stderr, "Usage: {} show <file>", args[0]);
+    std::println(stderr, "Usage: {} show <file>..", args[0]);
     return;
   }
 
-  jsn::value config, data;
-  if (!meow::get_json(CONFIG_PATH(), config) || !meow::get_json(DATA_PATH(), data))
-    return;
-
-  const std::string FILE = args[2];
-  if (FILE.empty())
-    meow::handle_error("File name is empty");
-
-  auto &files = meow::ensure_array(data, "files");
-  auto &aliases = meow::ensure_array(data, "aliases");
+  meow::context &ctx = meow::context::get();
+  const jsn::value &config = ctx.config();
+  const meow::snapshot &data = ctx.data();
 
-  auto show = [&](const std::string &name)
+  // Every name is resolved before anything is shown
+  std::vector<std::string> paths;
+  for (std::size_t i = 2; i < args.size(); ++i)
   {
-    auto file = std::ranges::find_if(files, [&](const jsn::value &f) { return f["name"].as_string() == name; });
+    const std::string &FILE = args[i];
+    if (FILE.empty())
+      meow::handle_error("File name is empty");
+
+    auto file = data.resolve(FILE);
+    if (!file)
+      meow::handle_error(std::format("File {} not found in data\n         Run ' {} help ' to see how to add files", FILE, args[0]));
+    if (file->path.empty())
+      meow::handle_error(std::format("data file is corrupted: '{}' has no path", file->name));
+    paths.emplace_back(file->path);
+  }
 
-    if (file == files.end())
+  // Binary and compressed files are paged as hex on a terminal whatever the backend: cat would dump them raw, bat
+  // only says that they are binary
+  const bool to_terminal = ::isatty(STDOUT_FILENO);
+  if (paths.size() == 1 && to_terminal)
+  {
+    using meow::filetype::kind;
+    const std::string path = meow::expand_paths(paths.front());
+    if (auto type = meow::filetype::of(path); type == kind::binary || type == kind::compressed)
+    {
+      meow::stats::scope pager("meow-pager");
+      meow::show_hex(meow::read_file(path).value_or(""), paths.front());
       return;
+    }
+  }
 
-    auto path = (*file)["path"].expect_string();
-    if (!path)
-      meow::handle_error(path.error());
-
-    std::string backend = config["backend"].string_opt().value_or("meow");
+  std::string_view backend = config["backend"].string_view_opt().value_or("meow");
 
-    if (backend == "bat")
-    {
-      auto bat_opts = config["bat-options"].array_opt().value_or({});
-      std::vector<std::string> options;
-      std::ranges::transform(bat_opts, std::back_inserter(options), [](const jsn::value &v) { return v.as_string(); });
+  // A backend that isn't installed falls back to the built-in pager
+  std::optional<std::string> executable;
+  if (backend == "bat" || backend == "cat")
+    executable = meow::backends::resolve(backend);
 
-      if (auto result = meow::show_file(*path, backend, options); !result)
-        meow::handle_error(result.error());
-    }
-    else if (backend == "cat")
-    {
-      auto cat_opts = config["cat-options"].array_opt().value_or({});
-      std::vector<std::string> options;
-      std::ranges::transform(cat_opts, std::back_inserter(options), [](const jsn::value &v) { return v.as_string(); });
+  auto meow_opts = config["meow-options"].array_view_opt().value_or(jsn::value::array_view{});
+  bool line_numbers = true;
+  int left_pad = 0;
+  for (const auto &meow_opt : meow_opts)
+  {
+    if (meow_opt.as_object().contains("line-numbers"))
+      line_numbers = meow_opt["line-numbers"].as_boolean();
+    else if (meow_opt.as_object().contains("left-padding"))
+      left_pad = static_cast<int>(meow_opt["left-padding"].as_number());
+  }
 
-      if (auto result = meow::show_file(*path, backend, options); !result)
-        meow::handle_error(result.error());
-    }
-    else
+  if (!executable)
+  {
+    for (const auto &path : paths)
     {
-      auto meow_opts = config["meow-options"].array_opt().value_or({});
-      bool line_numbers = true;
-      int left_pad = 0;
-      for (auto meow_opt : meow_opts)
-      {
-        if (meow_opt.as_object().contains("line-numbers"))
-          line_numbers = meow_opt["line-numbers"].as_boolean();
-        else if (meow_opt.as_object().contains("left-padding"))
-          left_pad = static_cast<int>(meow_opt["left-padding"].as_number());
-      }
-      meow::show_contents(meow::read_file(meow::expand_paths(*path)).value_or(""), *path, left_pad, line_numbers);
+      meow::stats::scope pager("meow-pager");
+      meow::show_contents(meow::read_file(meow::expand_paths(path)).value_or(""), path, left_pad, line_numbers);
     }
-  };
+    return;
+  }
+
+  auto backend_opts = config[backend == "bat" ? "bat-options" : "cat-options"].array_view_opt().value_or(jsn::value::array_view{});
+  std::vector<std::string> options;
+  std::ranges::transform(backend_opts, std::back_inserter(options), [](const jsn::value &v) { return v.as_string(); });
 
-  auto alias_match = std::ranges::find_if(aliases, [&](const jsn::value &a) { return a["alias"].as_string() == FILE; });
+  // "render-cache": reuse what the backend printed last time for an unchanged file
+  if (!config["render-cache"].boolean_opt().value_or(true))
+    meow::render_cache::set_limit(0);
+  else if (auto mb = config["render-cache-size-mb"].number_opt())
+    meow::render_cache::set_limit(static_cast<std::size_t>(std::max(*mb, 0.0) * 1024 * 1024));
 
-  if (alias_match != aliases.end())
-    return show((*alias_match)["file"].as_string());
+  if (auto seconds = config["backend-timeout"].number_opt())
+    meow::set_backend_timeout(std::chrono::milliseconds(static_cast<long long>(std::max(*seconds, 0.0) * 1000)));
+
+  std::expected<void, std::string> result;
+  if (paths.size() > 1)
+  {
+    // Rendered side by side into pipes, bat would drop its colours and decorations without being told
+    if (to_terminal && backend == "bat")
+      options.insert(options.begin(), {"--color=always", "--decorations=always"});
+    result = meow::show_files(paths, *executable, options);
+  }
+  // "pipeline": the backend's output goes through the built-in pager instead of straight to the terminal
+  else if (config["pipeline"].boolean_opt().value_or(false) && to_terminal)
+  {
+    if (backend == "bat")
+      options.insert(options.begin(), "--color=always");
+    result = meow::pipe_file(paths.front(), *executable, options, left_pad, line_numbers);
+  }
+  // bat on a terminal pages by itself, so it keeps the terminal; anything else goes through the render cache
+  else if (backend == "bat" && to_terminal)
+    result = meow::show_file(paths.front(), *executable, options);
   else
-    return show(FILE);
+    result = meow::show_files(paths, *executable, options);
 
-  meow::handle_error(std::format("File {} not found in data\n         Run ' {} help ' to see how to add files", FILE, args[0]));
+  if (!result)
+    meow::handle_error(result.error());
 }
 
 // add_file
-void add_file(std::vector<std::string> args)
+void add_file(const std::vector<std::string> &args)
 {
   std::optional<std::string> arg2 = std::nullopt;
 
@@ -205,10 +296,6 @@ void add_file(std::vector<std::string> args)
     meow::handle_error(std::format("Usage: {} add <file>", args[0]));
   }
 
-  jsn::value config, data;
-  if (!meow::get_json(CONFIG_PATH(), config) || !meow::get_json(DATA_PATH(), data))
-    return;
-
   std::string _file;
   if (arg2)
    _file = arg2.value();
@@ -224,18 +311,24 @@ void add_file(std::vector<std::string> args)
     meow::handle_error(std::format("File {} does not exist", FILE));
 
   std::string name = path.filename().string();
-  auto &files = meow::ensure_array(data, "files");
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
+  {
+    meow::ensure_array(data, "files");
+    meow::ensure_array(data, "aliases");
+
+    if (m.names().file(name))
+      meow::handle_error(std::format("File name {} already exists", name));
 
-  if (std::ranges::any_of(files, [&](const jsn::value &f) { return f["name"].as_string() == name; }))
-    meow::handle_error(std::format("File name {} already exists", name));
+    m.push("files", jsn::object_type{{"name", name}, {"path", path.string()}});
+  });
+  if (!updated)
+    return;
 
-  files.push_back(jsn::object_type{{"name", name}, {"path", path.string()}});
-  meow::write_data_or_error(DATA_PATH().c_str(), data);
   std::println("File {} added to meow", name);
 }
 
 // remove_file
-void remove_file(std::vector<std::string> args)
+void remove_file(const std::vector<std::string> &args)
 {
   if (args.size() != 3)
   {
@@ -243,24 +336,25 @@ void remove_file(std::vector<std::string> args)
     return;
   }
 
-  jsn::value config, data;
-  if (!meow::get_json(CONFIG_PATH(), config) || !meow::get_json(DATA_PATH(), data))
-    return;
-
-  auto &files = meow::ensure_array(data, "files");
-  auto &aliases = meow::ensure_array(data, "aliases");
   const std::string FILE = args[2];
   if (FILE.empty())
     meow::handle_error("File name is empty");
 
-  std::erase_if(files, [&](const jsn::value &val) { return val["name"].as_string() == FILE; });
-  std::erase_if(aliases, [&](const jsn::value &val) { return val["alias"].as_string() == FILE; });
-  meow::write_data_or_error(DATA_PATH().c_str(), data);
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
+  {
+    meow::ensure_array(data, "files");
+    meow::ensure_array(data, "aliases");
+    m.erase("files", "name", FILE);
+    m.erase("aliases", "alias", FILE);
+  });
+  if (!updated)
+    return;
+
   std::println("File {} removed from meow", FILE);
 }
 
 // add_alias
-void add_alias(std::vector<std::string> args)
+void add_alias(const std::vector<std::string> &args)
 {
   if (args.size() != 4)
   {
@@ -268,26 +362,28 @@ void add_alias(std::vector<std::string> args)
     return;
   }
 
-  jsn::value config, data;
-  if (!meow::get_json(CONFIG_PATH(), config) || !meow::get_json(DATA_PATH(), data))
-    return;
-
   std::string ALIAS = args[2], FILE = args[3];
   if (ALIAS.empty() || FILE.empty())
     meow::handle_error("Alias or file name is empty");
 
-  auto &aliases = meow::ensure_array(data, "aliases");
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
+  {
+    meow::ensure_array(data, "files");
+    meow::ensure_array(data, "aliases");
+
+    if (m.names().alias(ALIAS))
+      meow::handle_error(std::format("Alias name {} already exists", ALIAS));
 
-  if (std::ranges::any_of(aliases, [&](const jsn::value &f) { return f["alias"].as_string() == ALIAS; }))
-    meow::handle_error(std::format("Alias name {} already exists", ALIAS));
+    m.push("aliases", jsn::object_type{{"file", FILE}, {"alias", ALIAS}});
+  });
+  if (!updated)
+    return;
 
-  aliases.push_back(jsn::object_type{{"file", FILE}, {"alias", ALIAS}});
-  meow::write_data_or_error(DATA_PATH().c_str(), data);
   std::println("Alias {} for {} added to meow", ALIAS, FILE);
 }
 
 // remove_alias
-void remove_alias(std::vector<std::string> args)
+void remove_alias(const std::vector<std::string> &args)
 {
   if (args.size() != 3)
   {
@@ -295,113 +391,156 @@ void remove_alias(std::vector<std::string> args)
     return;
   }
 
-  jsn::value config, data;
-  if (!meow::get_json(CONFIG_PATH(), config) || !meow::get_json(DATA_PATH(), data))
-    return;
-
-  auto &aliases = meow::ensure_array(data, "aliases");
   std::string ALIAS = args[2];
   if (ALIAS.empty())
     meow::handle_error("Alias is empty");
 
-  auto original_size = aliases.size();
-
-  std::erase_if(aliases, [&](const jsn::value &entry) { return entry["alias"].as_string() == ALIAS; });
+  bool found = false;
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
+  {
+    meow::ensure_array(data, "aliases");
+    found = m.erase("aliases", "alias", ALIAS) > 0;
+  });
+  if (!updated)
+    return;
 
-  if (aliases.size() == original_size)
+  if (!found)
     return std::println(stderr, "[INFO]: Alias '{}' not found.", ALIAS);
 
-  meow::write_data_or_error(DATA_PATH().c_str(), data);
   std::println("Alias '{}' removed from meow", ALIAS);
 }
 
 // open_file
-void open_file(std::vector<std::string> args)
+void open_file(const std::vector<std::string> &args)
 {
   if (args.size() < 3)
   {
-    std::println(stderr, "Usage: {} open <file>", args[0]);
+    std::println(stderr, "Usage: {} open <file>[:line]..", args[0]);
     return;
   }
 
-  std::string FILE = args[2];
-  if (FILE.empty())
-    meow::handle_error("File name is empty");
-
-  jsn::value config, data;
-  if (!meow::get_json(DATA_PATH(), data))
-    return;
-
-  meow::ensure_array(data, "files");
-  meow::ensure_array(data, "aliases");
-
-  auto &files   = data["files"].ref_array();
-  auto &aliases = data["aliases"].ref_array();
+  const meow::snapshot &data = meow::context::get().data();
 
-  std::optional<std::string> path = std::nullopt;
+  // Names with an extension are more likely files than aliases
+  auto lookup = [&](std::string_view name) { return data.resolve(name, name.find('.') == std::string_view::npos); };
 
-  auto resolve_file_path = [&](const std::string &name) -> std::optional<std::string>
+  std::vector<meow::editor_target> targets;
+  for (std::size_t i = 2; i < args.size(); ++i)
   {
-    auto file = std::ranges::find_if(files, [&](const jsn::value &f) { return f["name"].as_string() == name; });
-    if (file != files.end())
-      return (*file)["path"].string_opt();
-    return std::nullopt;
-  };
-
-  if (FILE.find('.') == std::string::npos)
-  {
-    auto alias = std::ranges::find_if(aliases, [&](const jsn::value &a) { return a["alias"].as_string() == FILE; });
-
-    if (alias != aliases.end())
-      path = resolve_file_path((*alias)["file"].string_opt().value_or(""));
-    else
-      path = resolve_file_path(FILE);
-  }
-  else
-  {
-    path = resolve_file_path(FILE);
-    if (!path)
+    std::string_view FILE = args[i];
+    if (FILE.empty())
+      meow::handle_error("File name is empty");
+
+    // "name:42" opens at line 42, unless a file or alias is really called that
+    std::size_t line = 0;
+    auto file = lookup(FILE);
+    std::size_t colon = FILE.rfind(':');
+    if (!file && colon != std::string_view::npos && colon + 1 < FILE.size())
     {
-      auto alias = std::ranges::find_if(aliases, [&](const jsn::value &a) { return a["alias"].as_string() == FILE; });
-      if (alias != aliases.end())
-        path = resolve_file_path((*alias)["file"].string_opt().value_or(""));
+      std::string_view digits = FILE.substr(colon + 1);
+      auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), line);
+      if (ec == std::errc{} && end == digits.data() + digits.size())
+        file = lookup(FILE.substr(0, colon));
+      else
+        line = 0;
     }
+
+    if (!file)
+      meow::handle_error(std::format("File or alias '{}' not found in config", FILE));
+    targets.push_back({std::string(file->path), line});
   }
 
-  if (path)
+  // $EDITOR may carry arguments ("code --wait"), it is split like a shell would without running one
+  const char *editor = std::getenv("EDITOR");
+  auto editor_cmd = meow::split_args(editor && *editor ? editor : "nano");
+  if (!editor_cmd)
+    meow::handle_error(std::format("Can't parse $EDITOR: {}", editor_cmd.error()));
+  if (editor_cmd->empty())
+    meow::handle_error("$EDITOR is empty");
+
+  if (auto result = meow::open_in_editor(*editor_cmd, targets); !result)
+    meow::handle_error(result.error());
+}
+
+void meow_todo(const std::vector<std::string> &args)
+{
+  const meow::command *cmd = args.size() > 2 ? TODO_COMMANDS.find(args[2]) : nullptr;
+  if (!cmd)
   {
-    const char *editor = std::getenv("EDITOR");
-    std::string editor_cmd = editor ? editor : "nano";
-    std::string command = std::format("{} '{}'", editor_cmd, *path);
-    std::system(command.c_str());
+    meow::handle_error(std::format("Usage: {} todo <add|remove|toggle|list>", args[0]));
     return;
   }
 
-  std::println(stderr, "File or alias '{}' not found in config", FILE);
+  cmd->run(args);
 }
 
-void meow_todo(std::vector<std::string> args)
+// batch
+void run_batch(const std::vector<std::string> &args)
 {
-  if (args.size() <= 2)
+  if (args.size() > 3)
   {
-    meow::handle_error(std::format("Usage: {} todo <add|remove|list>", args[0]));
+    std::println(stderr, "Usage: {} batch [file|-]", args[0]);
     return;
   }
-  else if (args.size() > 2)
+
+  if (meow::data_batch::current())
+    meow::handle_error("batch can't be nested");
+
+  // Read up front, so commands that prompt on stdin can't eat the command stream
+  const bool from_stdin = args.size() == 2 || args[2] == "-";
+  std::optional<std::string> input = from_stdin ? meow::read_fd(STDIN_FILENO) : meow::read_file(args[2]);
+  if (!input)
+    meow::handle_error(std::format("Failed to read {}", from_stdin ? "stdin" : args[2]));
+
+  meow::data_batch batch(meow::context::get().data_path());
+  std::size_t line_no = 0, commands = 0, failed = 0;
+
+  std::string_view rest = *input;
+  while (!rest.empty())
   {
-    if (args[2] == "add")      return meow::todo::add(args);
-    if (args[2] == "remove")   return meow::todo::remove(args);
-    if (args[2] == "list")     return meow::todo::list(args);
-    if (args[2] == "toggle")   return meow::todo::toggle(args);
-    else
+    const std::size_t nl = rest.find('\n');
+    const std::string_view line = rest.substr(0, nl);
+    rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl + 1);
+    ++line_no;
+
+    auto words = meow::split_args(line);
+    if (!words)
     {
-      std::println(stderr, "Usage: {} todo <add|remove|list>", args[0]);
-      return void{};
+      std::println(stderr, "[ERROR]: batch line {}: {}", line_no, words.error());
+      ++commands, ++failed;
+      continue;
+    }
+    if (words->empty() || words->front().starts_with('#'))
+      continue;
+
+    std::vector<std::string> cmd{args[0]};
+    cmd.insert(cmd.end(), std::make_move_iterator(words->begin()), std::make_move_iterator(words->end()));
+    ++commands;
+
+    // A failing command is reported and skipped, the rest of the batch still runs
+    meow::recoverable_errors guard;
+    try
+    {
+      if (!dispatch(cmd))
+      {
+        std::println(stderr, "[ERROR]: batch line {}: unknown command ' {} '", line_no, cmd[1]);
+        ++failed;
+      }
+    }
+    catch (const meow::command_error &)
+    {
+      std::println(stderr, "         (batch line {})", line_no);
+      ++failed;
+    }
+    catch (const std::exception &e)
+    {
+      std::println(stderr, "[ERROR]: batch line {}: {}", line_no, e.what());
+      ++failed;
     }
   }
-  else
-  {
-    std::println(stderr, "Usage: {} todo <add|remove|list>", args[0]);
-    return void{};
-  }
+
+  batch.commit();
+
+  if (failed > 0)
+    meow::handle_error(std::format("{} of {} batch commands failed, the others were saved", failed, commands));
 }
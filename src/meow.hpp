@@ -1,17 +1,23 @@
 #pragma once
 
+#include <span>
 #include <vector>
 #include <string>
 
 #include "./json.hpp"
 
-void handle_args(std::vector<std::string> args);
+void handle_args(const std::vector<std::string> &args);
+// handle_args, turning escaped exceptions into an exit status
+int run_command(const std::vector<std::string> &args);
+// Whether the command never touches the terminal (prompts, pagers, editors), so it can run away from it
+bool runs_detached(std::span<char *const> argv);
 bool get_config(jsn::value &config);
-void show_file(std::vector<std::string> args);
-void add_file(std::vector<std::string> args);
-void show_all(std::vector<std::string> args);
-void remove_file(std::vector<std::string> args);
-void add_alias(std::vector<std::string> args);
-void remove_alias(std::vector<std::string> args);
-void open_file(std::vector<std::string> args);
-void meow_todo(std::vector<std::string> args);
+void show_file(const std::vector<std::string> &args);
+void add_file(const std::vector<std::string> &args);
+void show_all(const std::vector<std::string> &args);
+void remove_file(const std::vector<std::string> &args);
+void add_alias(const std::vector<std::string> &args);
+void remove_alias(const std::vector<std::string> &args);
+void open_file(const std::vector<std::string> &args);
+void meow_todo(const std::vector<std::string> &args);
+void run_batch(const std::vector<std::string> &args);
@@ -13,3 +13,10 @@ std::string paths::data_path()
   std::string base = xdg ? xdg : std::string(std::getenv("HOME")) + "/.local/share";
   return base + "/meow/data.json";
 }
+
+std::string paths::cache_dir()
+{
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  std::string base = xdg ? xdg : std::string(std::getenv("HOME")) + "/.cache";
+  return base + "/meow";
+}
@@ -7,6 +7,9 @@ namespace paths
 
   std::string data_path();
 
+  // Directory for caches meow can rebuild at any time ($XDG_CACHE_HOME/meow)
+  std::string cache_dir();
+
 void display_suggestions_horizontal(const std::vector<std::string> &matches, int &lines_used);
 void display_suggestions_vertical_limited(const std::vector<std::string> &matches, int &lines_used, int max_lines = 10);
 std::string prompt_path(const std::string &prompt = "File path: ", bool use_horizontal = true);
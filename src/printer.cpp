@@ -1,11 +1,13 @@
+#include <cerrno>
+#include <cstdio>
 #include <format>
-#include <iostream>
 #include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
 #include <ranges>
 #include <print>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <termios.h>
@@ -15,6 +17,8 @@
 #include <thread>
 
 #include "./printer.hpp"
+#include "./hexdump.hpp"
+#include "./supervisor.hpp"
 
 termios original_termios{};
 bool resize_flag = false;
@@ -73,6 +77,38 @@ namespace meow
     return result;
   }
 
+  // Length of the escape sequence starting at `i` (CSI like colours, or a two byte ESC x), 0 if there is none
+  static std::size_t escape_length(std::string_view line, std::size_t i)
+  {
+    if (line[i] != '\033' || i + 1 >= line.size())
+      return 0;
+    if (line[i + 1] != '[')
+      return 2;
+
+    std::size_t end = i + 2;
+    while (end < line.size() && !(line[end] >= 0x40 && line[end] <= 0x7e))
+      ++end;
+    return std::min(end + 1, line.size()) - i;
+  }
+
+  std::size_t display_width(std::string_view line)
+  {
+    std::size_t width = 0;
+    for (std::size_t i = 0; i < line.size();)
+    {
+      if (std::size_t esc = escape_length(line, i))
+      {
+        i += esc;
+        continue;
+      }
+      // UTF-8 continuation bytes belong to the previous character
+      if ((static_cast<unsigned char>(line[i]) & 0xc0) != 0x80)
+        ++width;
+      ++i;
+    }
+    return width;
+  }
+
   std::vector<std::string> wrap_line(std::string_view line, int width)
   {
     if (width <= 0) return {std::string(line)};
@@ -80,7 +116,30 @@ namespace meow
     std::vector<std::string> result;
     result.reserve((line.length() / width) + 1);
 
-    for (size_t i = 0; i < line.length(); i += width) result.push_back(std::string(line.substr(i, width)));
+    // Split by columns, not bytes: escape sequences take no room and are never cut, nor are UTF-8 characters
+    std::size_t start = 0;
+    int columns = 0;
+    for (std::size_t i = 0; i < line.size();)
+    {
+      if (std::size_t esc = escape_length(line, i))
+      {
+        i += esc;
+        continue;
+      }
+      if ((static_cast<unsigned char>(line[i]) & 0xc0) != 0x80)
+      {
+        if (columns == width)
+        {
+          result.push_back(std::string(line.substr(start, i - start)));
+          start = i;
+          columns = 0;
+        }
+        ++columns;
+      }
+      ++i;
+    }
+    if (start < line.size() || result.empty())
+      result.push_back(std::string(line.substr(start)));
     return result;
   }
 
@@ -92,7 +151,7 @@ namespace meow
     return c;
   }
 
-  Key parse_key()
+  Key parse_key(int wake_fd)
   {
     auto start = std::chrono::steady_clock::now();
     while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100))
@@ -100,12 +159,16 @@ namespace meow
       fd_set readfds;
       FD_ZERO(&readfds);
       FD_SET(STDIN_FILENO, &readfds);
+      if (wake_fd >= 0)
+        FD_SET(wake_fd, &readfds);
 
       struct timeval tv;
       tv.tv_sec = 0;
       tv.tv_usec = 10000;
 
-      int ready = select(STDIN_FILENO + 1, &readfds, NULL, NULL, &tv);
+      int ready = select(std::max(STDIN_FILENO, wake_fd) + 1, &readfds, NULL, NULL, &tv);
+      if (ready > 0 && !FD_ISSET(STDIN_FILENO, &readfds))
+        return Key::Unknown;  // Only wake_fd has something, let the caller read it
       if (ready > 0)
       {
         char c = read_key();
@@ -211,9 +274,10 @@ namespace meow
                                                  int term_width,
                                                  bool show_line_numbers,
                                                  int left_padding,
-                                                 int &lnw)
+                                                 int &lnw,
+                                                 std::size_t first)
   {
-    if (original_lines.empty()) return {};
+    if (original_lines.size() <= first) return {};
 
     std::vector<std::string> result;
     const int total_lines = original_lines.size();
@@ -227,16 +291,18 @@ namespace meow
 
     // Pre-calculate how many lines we'll need (estimate)
     int estimated_total_lines = 0;
-    for (const auto &line : original_lines) estimated_total_lines += (line.length() / content_width) + 1;
+    for (size_t i = first; i < original_lines.size(); ++i) estimated_total_lines += (original_lines[i].length() / content_width) + 1;
     result.reserve(estimated_total_lines);
 
     // Process each original line
-    for (size_t i = 0; i < original_lines.size(); ++i)
+    for (size_t i = first; i < original_lines.size(); ++i)
     {
       const auto &line = original_lines[i];
 
       // Only wrap if needed to avoid unnecessary work
-      auto wraps = ((int)line.length() <= content_width) ? std::vector<std::string>{std::string(line)} : wrap_line(line, content_width);
+      auto wraps = ((int)line.length() <= content_width || (int)display_width(line) <= content_width)
+                     ? std::vector<std::string>{std::string(line)}
+                     : wrap_line(line, content_width);
 
       // Cache the line number string to avoid recalculating
       std::string line_number;
@@ -329,10 +395,10 @@ namespace meow
 
         // Ensure line fits in terminal width
         std::string_view line_content = wrapped_lines[i];
-        if (margin.length() + line_content.length() > static_cast<size_t>(term_width))
-          line_content = line_content.substr(0, term_width - margin.length());
+        if (display_width(margin) + display_width(line_content) > static_cast<size_t>(term_width))
+          line_content = wrap_line(line_content, term_width - display_width(margin)).front();
 
-        std::print("{}{}\n", margin, line_content);
+        std::print("{}{}\033[0m\n", margin, line_content);
       }
       ++line_num;
     }
@@ -341,14 +407,67 @@ namespace meow
     std::print("{}\n", make_border("┴"));
   }
 
-  void show_contents(std::string_view content, std::string_view title, int left_padding, bool show_line_numbers)
+  // Lines read from a backend's pipe, split as they arrive
+  struct line_source
+  {
+    int fd = -1;
+    std::string partial;
+    stream_capture *capture = nullptr;  // Receives every byte read, when set
+    supervisor *sv = nullptr;           // Enforces the writer's deadline while it loads, when set
+
+    [[nodiscard]] bool open() const noexcept { return fd >= 0; }
+
+    // Takes whatever is available without blocking (in large reads), appending complete lines. Once the writer is
+    // done the unterminated rest becomes the last line and the source is closed.
+    void pump(std::vector<std::string> &lines)
+    {
+      char buf[64 * 1024];
+      while (fd >= 0)
+      {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          return;
+        if (n <= 0)
+        {
+          if (!partial.empty())
+            lines.push_back(std::move(partial));
+          partial.clear();
+          fd = -1;
+          return;
+        }
+
+        std::string_view chunk(buf, static_cast<std::size_t>(n));
+        if (capture && !capture->dropped)
+        {
+          if (capture->bytes.size() + chunk.size() > capture->limit)
+          {
+            capture->dropped = true;
+            std::string().swap(capture->bytes);
+          }
+          else
+            capture->bytes.append(chunk);
+        }
+        for (std::size_t nl; (nl = chunk.find('\n')) != std::string_view::npos; chunk.remove_prefix(nl + 1))
+        {
+          partial.append(chunk.substr(0, nl));
+          lines.push_back(std::move(partial));
+          partial.clear();
+        }
+        partial.append(chunk);
+      }
+    }
+  };
+
+  // With `binary` set, that is paged as hex rows instead of `original_lines`
+  static void page(std::vector<std::string> original_lines, line_source &source, std::string_view title, int left_padding,
+                   bool show_line_numbers, std::string_view binary = {})
   {
     enable_raw_mode();
     setup_resize_handler();
     running = true;
 
-    auto original_lines = split_lines(content);
-
     auto [term_width, term_height] = terminal_dimensions();
     if (term_width < 45 || term_height < 10)
     {
@@ -361,7 +480,23 @@ namespace meow
 
     // Build initial display
     auto visible_lines = rebuild_visible_lines(original_lines, term_width, show_line_numbers, left_padding, lnw);
-    if (visible_lines.size() < static_cast<size_t>(term_height))
+
+    // Hex rows are formatted when drawn, there are as many as it takes to hold the bytes at the current width
+    const bool hex = !binary.empty();
+    const int offset_width = hexdump::offset_width(binary.size());
+    std::size_t bytes_per_row = hexdump::bytes_per_row(term_width, offset_width);
+    std::string hex_row;
+    auto row_count = [&] { return hex ? (binary.size() + bytes_per_row - 1) / bytes_per_row : visible_lines.size(); };
+    auto row_at = [&](std::size_t idx) -> std::string_view
+    {
+      if (!hex)
+        return visible_lines[idx];
+      hex_row.clear();
+      hexdump::format_row(binary, idx, bytes_per_row, offset_width, hex_row);
+      return hex_row;
+    };
+
+    if (!hex && !source.open() && visible_lines.size() < static_cast<size_t>(term_height))
     {
       disable_raw_mode();
       simple_cat(original_lines, title, term_width, term_height, left_padding, show_line_numbers);
@@ -376,24 +511,55 @@ namespace meow
     // Main loop
     while (running)
     {
+      // Lines still arriving are wrapped and appended on their own, unless the line numbers just got wider
+      bool stream_changed = false;
+      if (source.open())
+      {
+        // A backend past its deadline is terminated, its output then ends like any other
+        if (source.sv)
+          source.sv->poll({}, std::chrono::milliseconds(0));
+
+        const std::size_t before = original_lines.size();
+        source.pump(original_lines);
+        if (original_lines.size() != before)
+        {
+          const int old_lnw = lnw;
+          auto added = rebuild_visible_lines(original_lines, term_width, show_line_numbers, left_padding, lnw, before);
+          if (lnw == old_lnw)
+            visible_lines.insert(visible_lines.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+          else
+          {
+            visible_lines = rebuild_visible_lines(original_lines, term_width, show_line_numbers, left_padding, lnw);
+            need_full_redraw = true;
+          }
+        }
+        stream_changed = original_lines.size() != before || !source.open();
+      }
+
       if (resize_flag)
       {
         resize_flag = false;
         std::tie(term_width, term_height) = terminal_dimensions();
         view_lines = term_height - 5;
         visible_lines = rebuild_visible_lines(original_lines, term_width, show_line_numbers, left_padding, lnw);
+        if (hex)
+        {
+          // Keep the byte at the top in view
+          const std::size_t previous_bytes_per_row = std::exchange(bytes_per_row, hexdump::bytes_per_row(term_width, offset_width));
+          offset = static_cast<int>(offset * previous_bytes_per_row / bytes_per_row);
+        }
         need_full_redraw = true;
 
-        if (offset + view_lines > static_cast<int>(visible_lines.size()))
-          offset = std::max(0, static_cast<int>(visible_lines.size()) - view_lines);
+        if (offset + view_lines > static_cast<int>(row_count()))
+          offset = std::max(0, static_cast<int>(row_count()) - view_lines);
       }
 
-      if (need_full_redraw || offset != prev_offset)
+      if (need_full_redraw || offset != prev_offset || stream_changed)
       {
         if (need_full_redraw)
           clear_screen();
 
-        int margin_size = show_line_numbers ? lnw + 1 : left_padding;
+        int margin_size = hex ? offset_width + 1 : show_line_numbers ? lnw + 1 : left_padding;
 
         // Draw header
         if (need_full_redraw)
@@ -421,10 +587,10 @@ namespace meow
         for (int i = 0; i < view_lines; ++i)
         {
           int idx = i + offset;
-          if (idx < (int)visible_lines.size())
+          if (idx < (int)row_count())
           {
             std::print("\033[{};1H", i + content_start_row);
-            std::print("{}", visible_lines[idx]);
+            std::print("{}\033[0m", row_at(idx));
           }
         }
 
@@ -435,10 +601,12 @@ namespace meow
         std::print("\033[{};1H\033[2K", term_height);
 
         // Show scroll percentage
-        int percentage = visible_lines.empty() ? 100 : std::min(100, static_cast<int>((offset + view_lines) * 100 / visible_lines.size()));
+        const std::size_t rows = row_count();
+        int percentage = rows == 0 ? 100 : std::min(100, static_cast<int>((offset + view_lines) * 100 / rows));
 
         std::print("\033[1;38;5;248m");
-        std::string footer = std::format(" PgUp/PgDn | Line: {}/{} ({:3}%) | q:quit", offset + 1, visible_lines.empty() ? 1 : visible_lines.size(), percentage);
+        std::string footer = std::format(" PgUp/PgDn | Line: {}/{} ({:3}%){} | q:quit", offset + 1, rows == 0 ? 1 : rows,
+                                         percentage, source.open() ? " | loading" : "");
         //int visible_chars = 0;
         if (footer.size() + 3 > static_cast<size_t>(term_width))  // +3 for up/down arrows
           footer = footer.substr(0, term_width - 7) + "...\033[0m";
@@ -447,11 +615,11 @@ namespace meow
 
         need_full_redraw = false;
         prev_offset = offset;
-        std::cout.flush();
+        std::fflush(stdout);
       }
 
-      // Handle input
-      Key key = parse_key();
+      // Handle input, new lines from the source interrupt the wait
+      Key key = parse_key(source.fd);
       switch (key)
       {
         case Key::ArrowUp:
@@ -459,20 +627,20 @@ namespace meow
             offset--;
           break;
         case Key::ArrowDown:
-          if (offset + view_lines < static_cast<int>(visible_lines.size()))
+          if (offset + view_lines < static_cast<int>(row_count()))
             offset++;
           break;
         case Key::PageUp:
           offset = std::max(0, offset - view_lines);
           break;
         case Key::PageDown:
-          offset = std::min(static_cast<int>(visible_lines.size()) - view_lines, offset + view_lines);
+          offset = std::max(0, std::min(static_cast<int>(row_count()) - view_lines, offset + view_lines));
           break;
         case Key::Home:
           offset = 0;
           break;
         case Key::End:
-          offset = std::max(0, static_cast<int>(visible_lines.size()) - view_lines);
+          offset = std::max(0, static_cast<int>(row_count()) - view_lines);
           break;
         case Key::Quit:
           running = false;
@@ -494,4 +662,40 @@ namespace meow
     clear_screen();
     disable_raw_mode();
   }
+
+  void show_contents(std::string_view content, std::string_view title, int left_padding, bool show_line_numbers)
+  {
+    line_source none{};
+    if (hexdump::looks_binary(content))
+      page({}, none, title, left_padding, show_line_numbers, content);
+    else
+      page(split_lines(content), none, title, left_padding, show_line_numbers);
+  }
+
+  void show_hex(std::string_view content, std::string_view title)
+  {
+    line_source none{};
+    page({}, none, title, 0, false, content);
+  }
+
+  bool show_stream(int fd, std::string_view title, int left_padding, bool show_line_numbers, stream_capture *capture,
+                   supervisor *sv)
+  {
+    line_source source{fd, {}, capture, sv};
+    std::vector<std::string> lines;
+
+    // Wait for a screenful first: if everything arrives before that, it is printed like any short file
+    const auto [_, term_height] = terminal_dimensions();
+    for (source.pump(lines); source.open() && lines.size() < static_cast<std::size_t>(term_height); source.pump(lines))
+    {
+      pollfd pfd{fd, POLLIN, 0};
+      if (sv)
+        sv->poll(std::span(&pfd, 1));
+      else if (::poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        break;
+    }
+
+    page(std::move(lines), source, title, left_padding, show_line_numbers);
+    return !source.open();
+  }
 }  // namespace meow
@@ -9,6 +9,8 @@
 
 namespace meow
 {
+  class supervisor;
+
   void disable_raw_mode();
 
   void enable_raw_mode();
@@ -31,7 +33,8 @@ namespace meow
     Unknown
   };
 
-  Key parse_key();
+  // Waits up to 100ms for a key, returning early (Key::Unknown) when `wake_fd` becomes readable
+  Key parse_key(int wake_fd = -1);
 
   std::pair<int, int> terminal_dimensions();
 
@@ -39,6 +42,9 @@ namespace meow
 
   std::vector<std::string> split_lines(std::string_view str);
 
+  // Terminal columns taken by the line: escape sequences count for nothing, UTF-8 characters for one
+  std::size_t display_width(std::string_view line);
+
   // TODO: Wrap by word
   std::vector<std::string> wrap_line(std::string_view line, int width);
 
@@ -46,11 +52,32 @@ namespace meow
 
   void draw_title_bar(int row, std::string_view title, int margin_size);
 
+  // Wrapped and margined display lines for original_lines[first..], numbered as lines of the whole text
   std::vector<std::string> rebuild_visible_lines(const std::vector<std::string> &original_lines,
                                                  int term_width,
                                                  bool show_line_numbers,
                                                  int left_padding,
-                                                 int &lnw);
+                                                 int &lnw,
+                                                 std::size_t first = 0);
 
+  // Binary content (see hexdump::looks_binary) is shown as a hex view
   void show_contents(std::string_view content, std::string_view title, int left_padding = 2, bool show_line_numbers = false);
+
+  // The hex view, for content already known to be binary
+  void show_hex(std::string_view content, std::string_view title);
+
+  // A copy of everything a stream delivered, given up (and freed) as soon as it would grow past `limit`
+  struct stream_capture
+  {
+    std::string bytes;
+    std::size_t limit = 0;
+    bool dropped = false;
+  };
+
+  // Pages what is read from `fd` (non-blocking) as it arrives, e.g. a backend's output, copying it to `capture` when
+  // given. While it loads, waiting goes through `sv` (when given) so the backends it supervises are stopped at their
+  // deadlines; the pager stays open with what arrived. Returns whether `fd` was read to the end before the pager was
+  // quit. The caller closes `fd`.
+  bool show_stream(int fd, std::string_view title, int left_padding = 2, bool show_line_numbers = false,
+                   stream_capture *capture = nullptr, supervisor *sv = nullptr);
 }  // namespace meow
@@ -1,20 +1,35 @@
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <format>
+#include <optional>
 #include <print>
 #include <vector>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+
 #include "./procs.hpp"
 #include "./utils.hpp"
+#include "./printer.hpp"
+#include "./backends.hpp"
+#include "./stats.hpp"
+#include "./render_cache.hpp"
+#include "./supervisor.hpp"
+
+extern char **environ;
 
 namespace meow
 {
-  std::expected<int, std::string> wait_for_process(pid_t pid, std::string name)
-  {
-    int status = 0;
-    pid_t result = waitpid(pid, &status, 0);
+  static std::chrono::milliseconds backend_timeout{0};
 
-    if (result == -1)
-      return std::unexpected(std::format("waitpid failed for PID {}", pid));
+  void set_backend_timeout(std::chrono::milliseconds timeout) { backend_timeout = timeout; }
 
+  static std::expected<int, std::string> exit_code(pid_t pid, const std::string &name, int status)
+  {
     if (WIFEXITED(status))
     {
       int exit_code = WEXITSTATUS(status);
@@ -36,52 +51,365 @@ namespace meow
     return std::unexpected(std::format("Process {} did not exit normally", pid));
   }
 
-  pid_t create_process(const std::vector<std::string> &args)
+  std::expected<int, std::string> wait_for_process(supervisor &sv, pid_t pid, std::string name)
   {
-    pid_t pid = fork();
+    return exit_code(pid, name, sv.wait(pid));
+  }
 
-    if (pid == -1)
-    {
-      perror("fork");
-      return -1;
-    }
-    else if (pid == 0)
-    {
-      std::vector<std::string> expanded_args;
+  static std::string timed_out(std::string_view backend)
+  {
+    return std::format("{} didn't finish within {}s and was stopped", backend,
+                       std::chrono::duration<double>(backend_timeout).count());
+  }
+
+  pid_t create_process(const std::vector<std::string> &args, int stdout_fd, bool foreground)
+  {
+    // Everything is prepared here: posix_spawnp runs the child on our memory (vfork-like) until it execs, so it must
+    // not allocate, and its cost doesn't grow with whatever meow has mapped
+    std::vector<std::string> expanded_args;
+    expanded_args.reserve(args.size());
+    for (auto &arg : args)
+      expanded_args.push_back(meow::expand_paths(arg));
 
-      for (auto &arg : args)
-        expanded_args.push_back(meow::expand_paths(arg));
+    std::vector<char *> argv;
+    argv.reserve(expanded_args.size() + 1);
+    for (auto &arg : expanded_args)
+      argv.push_back(arg.data());
+    argv.push_back(nullptr);
 
-      std::vector<char *> argv;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (stdout_fd >= 0)
+      posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
 
-      for (auto &arg : expanded_args)
-        argv.push_back(const_cast<char *>(arg.data()));
-      argv.push_back(nullptr);
+    // Backends writing into a pager that was quit should die quietly even if meow was started with SIGPIPE ignored
+    posix_spawnattr_t attrs;
+    posix_spawnattr_init(&attrs);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attrs, &defaults);
+    short flags = POSIX_SPAWN_SETSIGDEF;
 
-      execvp(argv[0], argv.data());
+    // A foreground child only gets a group of its own together with the terminal, handed over in the child between
+    // setpgid and exec, so it never runs as a background job that would be stopped for opening /dev/tty. Where that
+    // can't be done (stdin isn't the terminal, meow isn't the foreground job, or libc can't do it) it stays in meow's
+    // group as it used to.
+    if (!foreground)
+      flags |= POSIX_SPAWN_SETPGROUP;
+    else if (::isatty(STDIN_FILENO) && ::tcgetpgrp(STDIN_FILENO) == ::getpgrp())
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+      posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+      flags |= POSIX_SPAWN_SETPGROUP;
+#endif
+    }
+    posix_spawnattr_setpgroup(&attrs, 0);
+    posix_spawnattr_setflags(&attrs, flags);
 
-      perror("execvp");
-      _exit(1);
+    pid_t pid = -1;
+    const auto start = std::chrono::steady_clock::now();
+    int err = posix_spawnp(&pid, argv[0], &actions, &attrs, argv.data(), environ);
+    posix_spawnattr_destroy(&attrs);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0)
+    {
+      std::println(stderr, "posix_spawnp: {}: {}", argv[0], std::strerror(err));
+      return -1;
     }
 
+    std::string_view name = argv[0];
+    meow::stats::process_started(pid, name.substr(name.rfind('/') + 1), start);
     return pid;
   }
 
   std::expected<void, std::string> show_file(const std::string &file, std::string_view backend, std::vector<std::string> options)
   {
-    std::vector<std::string> args = {std::string(backend.data()), file};
+    std::vector<std::string> args = {std::string(backend), file};
     for (auto opts: options)
       args.push_back(opts);
 
-    pid_t pid = create_process(args);
+    supervisor sv;
+    pid_t pid = create_process(args, -1, true);
     if (pid == -1)
-      return std::unexpected("Failed to fork process");
+      return std::unexpected(std::format("Failed to start {}", backend));
+    sv.adopt(pid);
 
-    auto result = wait_for_process(pid, "bat");
+    auto result = wait_for_process(sv, pid, std::string(backend));
 
     if (!result)
       return std::unexpected(result.error());
 
     return {};
   }
+
+  std::expected<void, std::string> pipe_file(const std::string &file, std::string_view backend, const std::vector<std::string> &options,
+                                             int left_padding, bool line_numbers)
+  {
+    // A cached render is paged straight from the cache file
+    auto cache_key = render_cache::key_for(file, backend, options, meow::terminal_dimensions().first);
+    if (auto cached = cache_key ? render_cache::lookup(*cache_key) : std::nullopt)
+    {
+      ::lseek(cached->fd, cached->offset, SEEK_SET);
+      meow::stats::scope pager("meow-pager");
+      meow::show_stream(cached->fd, file, left_padding, line_numbers);
+      ::close(cached->fd);
+      return {};
+    }
+
+    std::vector<std::string> args = {std::string(backend), file};
+    args.insert(args.end(), options.begin(), options.end());
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0)
+      return std::unexpected(std::format("Failed to create a pipe: {}", std::strerror(errno)));
+
+    supervisor sv;
+    pid_t pid = create_process(args, fds[1]);
+    ::close(fds[1]);
+    if (pid == -1)
+    {
+      ::close(fds[0]);
+      return std::unexpected(std::format("Failed to start {}", backend));
+    }
+    sv.adopt(pid, backend_timeout);
+
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    meow::stream_capture rendered;
+    rendered.limit = cache_key ? render_cache::capacity(*cache_key) : 0;
+    bool complete = false;
+    {
+      meow::stats::scope pager("meow-pager");
+      complete = meow::show_stream(fds[0], file, left_padding, line_numbers, cache_key ? &rendered : nullptr, &sv);
+    }
+    // Quitting the pager early stops the backend, that's not its failure. Neither is Ctrl-C, which stops loading
+    // like it does in less, the pager stays open.
+    ::close(fds[0]);
+    if (!complete)
+      sv.terminate(pid);
+    const int status = sv.wait(pid);
+    supervisor::absorb_interrupt();
+
+    if (sv.timed_out(pid))
+      return std::unexpected(timed_out(backend));
+    if (WIFSIGNALED(status) && (!complete || WTERMSIG(status) == SIGPIPE || WTERMSIG(status) == SIGINT))
+      return {};
+    if (auto result = exit_code(pid, std::string(backend), status); !result)
+      return std::unexpected(result.error());
+    if (complete && cache_key && !rendered.dropped)
+      render_cache::store(*cache_key, rendered.bytes);
+    return {};
+  }
+
+  std::expected<void, std::string> show_files(const std::vector<std::string> &files, std::string_view backend,
+                                              const std::vector<std::string> &options, int out_fd)
+  {
+    struct render
+    {
+      pid_t pid = -1;
+      int fd = -1;  // Closed at the end of the output, the backend may still be exiting
+      std::string output;
+      bool done = false;
+      std::string error;
+      std::optional<std::string> cache_key;
+      std::optional<render_cache::entry> cached;
+      std::string rendered;  // Everything the backend printed, kept for the cache while it fits
+    };
+
+    // Renders already in the cache are served from there, the backend isn't run at all
+    const int width = ::isatty(out_fd) ? meow::terminal_dimensions().first : 0;
+    std::vector<render> renders(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      renders[i].cache_key = render_cache::key_for(files[i], backend, options, width);
+      if (renders[i].cache_key && (renders[i].cached = render_cache::lookup(*renders[i].cache_key)))
+        renders[i].done = true;
+    }
+    const std::size_t cores = static_cast<std::size_t>(std::max(1L, ::sysconf(_SC_NPROCESSORS_ONLN)));
+    std::size_t started = 0, emitted = 0, running = 0;
+    supervisor sv;
+
+    auto start = [&](render &r, const std::string &file)
+    {
+      if (r.cached)
+        return;
+
+      std::vector<std::string> args = {std::string(backend), file};
+      args.insert(args.end(), options.begin(), options.end());
+
+      int fds[2];
+      if (::pipe2(fds, O_CLOEXEC) != 0)
+      {
+        r.done = true;
+        r.error = std::format("Failed to create a pipe: {}", std::strerror(errno));
+        return;
+      }
+      r.pid = create_process(args, fds[1]);
+      ::close(fds[1]);
+      if (r.pid == -1)
+      {
+        ::close(fds[0]);
+        r.done = true;
+        r.error = std::format("Failed to start {}", backend);
+        return;
+      }
+      sv.adopt(r.pid, backend_timeout);
+      ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+      r.fd = fds[0];
+      ++running;
+    };
+
+    // A render is done once its output ended and the backend exited
+    auto finish = [&](render &r, int status)
+    {
+      --running;
+      if (auto result = exit_code(r.pid, std::string(backend), status); !result)
+        r.error = sv.timed_out(r.pid) && WIFSIGNALED(status) ? timed_out(backend) : result.error();
+      else if (r.cache_key)
+        render_cache::store(*r.cache_key, r.rendered);
+      r.rendered.clear();
+      r.done = true;
+    };
+
+    std::fflush(stdout);
+    bool writable = true;
+    int write_error = 0;
+    while (emitted < renders.size())
+    {
+      // Nobody reads the output anymore, or meow was interrupted: what runs is stopped, the rest never starts
+      if (!writable || supervisor::received())
+      {
+        for (std::size_t i = emitted; i < renders.size(); ++i)
+          if (i >= started)
+            renders[i].done = true;
+          else if (!renders[i].done)
+            sv.terminate(renders[i].pid);
+        started = renders.size();
+      }
+
+      while (running < cores && started < renders.size())
+      {
+        start(renders[started], files[started]);
+        ++started;
+      }
+
+      // The oldest unfinished render goes out as it comes, finished ones behind it follow
+      while (emitted < renders.size())
+      {
+        render &head = renders[emitted];
+        if (writable && !head.output.empty() && !(writable = write_all(out_fd, head.output)))
+          write_error = errno;
+        if (head.cached)
+        {
+          if (writable && !(writable = render_cache::send(*head.cached, out_fd)))
+            write_error = errno;
+          else if (!writable)
+            ::close(head.cached->fd);
+          head.cached.reset();
+        }
+        head.output.clear();
+        head.output.shrink_to_fit();
+        if (!head.done)
+          break;
+        ++emitted;
+      }
+      if (emitted == renders.size())
+        break;
+
+      // Outputs, backend exits, signals and timeouts all wake the same poll
+      std::vector<pollfd> pfds;
+      std::vector<render *> polled;
+      for (auto &r : renders)
+        if (r.fd >= 0)
+        {
+          pfds.push_back({r.fd, POLLIN, 0});
+          polled.push_back(&r);
+        }
+      sv.poll(pfds);
+
+      char buf[64 * 1024];
+      for (std::size_t i = 0; i < pfds.size(); ++i)
+      {
+        if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+          continue;
+        render &r = *polled[i];
+        while (true)
+        {
+          ssize_t n = ::read(r.fd, buf, sizeof(buf));
+          if (n > 0)
+          {
+            r.output.append(buf, static_cast<std::size_t>(n));
+            // A render too large for the cache isn't kept around for it
+            if (r.cache_key && r.rendered.size() + static_cast<std::size_t>(n) > render_cache::capacity(*r.cache_key))
+            {
+              r.cache_key.reset();
+              std::string().swap(r.rendered);
+            }
+            else if (r.cache_key)
+              r.rendered.append(buf, static_cast<std::size_t>(n));
+            continue;
+          }
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+          {
+            ::close(r.fd);
+            r.fd = -1;
+          }
+          break;
+        }
+      }
+
+      for (auto &r : renders)
+        if (r.pid > 0 && r.fd < 0 && !r.done)
+          if (auto status = sv.status(r.pid))
+            finish(r, *status);
+    }
+
+    if (!writable)
+      return std::unexpected(std::format("Failed to write the output: {}", std::strerror(write_error)));
+    std::string errors;
+    for (std::size_t i = 0; i < renders.size(); ++i)
+      if (!renders[i].error.empty())
+        errors += std::format("{}{}: {}", errors.empty() ? "" : "\n         ", files[i], renders[i].error);
+    if (!errors.empty())
+      return std::unexpected(errors);
+    return {};
+  }
+
+  std::expected<void, std::string> open_in_editor(const std::vector<std::string> &editor, const std::vector<editor_target> &files)
+  {
+    // Resolved like the show backends, so the child doesn't walk $PATH either
+    auto executable = meow::backends::resolve(editor.front());
+    if (!executable)
+      return std::unexpected(std::format("Editor '{}' not found", editor.front()));
+
+    const std::string_view name = std::string_view(editor.front()).substr(editor.front().rfind('/') + 1);
+    const bool goto_flag = name == "code" || name == "codium" || name == "code-insiders";
+    const bool colon_suffix = name == "subl" || name == "hx" || name == "zed";
+
+    std::vector<std::string> args = {*executable};
+    args.insert(args.end(), editor.begin() + 1, editor.end());
+    for (const auto &file : files)
+    {
+      if (file.line == 0)
+        args.push_back(file.path);
+      else if (goto_flag)
+        args.insert(args.end(), {"--goto", std::format("{}:{}", file.path, file.line)});
+      else if (colon_suffix)
+        args.push_back(std::format("{}:{}", file.path, file.line));
+      else
+        args.insert(args.end(), {std::format("+{}", file.line), file.path});
+    }
+
+    supervisor sv;
+    pid_t pid = create_process(args, -1, true);
+    if (pid == -1)
+      return std::unexpected(std::format("Failed to start {}", editor.front()));
+    sv.adopt(pid);
+
+    if (auto result = wait_for_process(sv, pid, std::string(name)); !result)
+      return std::unexpected(result.error());
+    return {};
+  }
 }
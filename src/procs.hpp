@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string_view>
 #include <vector>
 #include <expected>
@@ -12,9 +13,38 @@
 
 namespace meow
 {
-  std::expected<int, std::string> wait_for_process(pid_t pid, std::string name = "");
+  class supervisor;
 
-  pid_t create_process(const std::vector<std::string> &args);
+  // Waits for a child adopted by `sv` and turns its status into an error unless it exited with 0
+  std::expected<int, std::string> wait_for_process(supervisor &sv, pid_t pid, std::string name = "");
+
+  // "backend-timeout": renders meow captures (several files, pipeline mode) are killed after this long, 0 never
+  void set_backend_timeout(std::chrono::milliseconds timeout);
+
+  struct editor_target
+  {
+    std::string path;
+    std::size_t line = 0;  // 0 to open at the top
+  };
+
+  // The child runs in a process group of its own. `stdout_fd`, when given, becomes its stdout. A `foreground` child is
+  // for backends and editors the user interacts with: it is handed the terminal along with its group when meow has
+  // the terminal, and otherwise stays in meow's group.
+  pid_t create_process(const std::vector<std::string> &args, int stdout_fd = -1, bool foreground = false);
 
   std::expected<void, std::string> show_file(const std::string &file, std::string_view bakcdend, std::vector<std::string> options = {});
+
+  // Renders several files at once, one backend per core at most, and writes their outputs to `out_fd` in order: the
+  // first file streams through as it is rendered, later ones are held until everything before them is written.
+  // Renders found in the render cache are sent from there instead.
+  std::expected<void, std::string> show_files(const std::vector<std::string> &files, std::string_view backend,
+                                              const std::vector<std::string> &options, int out_fd = STDOUT_FILENO);
+
+  // Opens the files in the editor (its command line already split into words) and waits for it to exit. Lines are
+  // passed as "+N file", or in the form the few editors that don't take that expect.
+  std::expected<void, std::string> open_in_editor(const std::vector<std::string> &editor, const std::vector<editor_target> &files);
+
+  // Runs the backend with its stdout on a pipe and pages that output with the built-in pager while it is produced
+  std::expected<void, std::string> pipe_file(const std::string &file, std::string_view backend, const std::vector<std::string> &options,
+                                             int left_padding, bool line_numbers);
 }  // namespace prc
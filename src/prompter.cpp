@@ -1,7 +1,7 @@
 #include <algorithm>
 #include <filesystem>
-#include <iomanip>
-#include <iostream>
+#include <cstdio>
+#include <print>
 #include <string>
 #include <termios.h>
 #include <unistd.h>
@@ -63,24 +63,25 @@ std::string prompt::common_prefix(const std::vector<std::string> &items)
 void prompt::move_cursor_up(int n)
 {
   if (n > 0)
-    std::cout << "\033[" << n << "A";
+    std::print("\033[{}A", n);
 }
 
 void prompt::move_cursor_down(int n)
 {
   if (n > 0)
-    std::cout << "\033[" << n << "B";
+    std::print("\033[{}B", n);
 }
 
 void prompt::clear_lines_below(int n)
 {
-  for (int i = 0; i < n; ++i) std::cout << "\033[E\033[2K";
+  for (int i = 0; i < n; ++i) std::print("\033[E\033[2K");
   move_cursor_up(n);
 }
 
 void prompt::redraw_prompt(const std::string &prompt, const std::string &buffer)
 {
-  std::cout << "\r\033[K" << prompt << buffer << std::flush;
+  std::print("\r\033[K{}{}", prompt, buffer);
+  std::fflush(stdout);
 }
 
 void prompt::display_suggestions_horizontal(const std::vector<std::string> &matches, int &lines_used)
@@ -113,15 +114,15 @@ void prompt::display_suggestions_horizontal(const std::vector<std::string> &matc
   int items_shown = 0;
   lines_used = 0;
 
-  std::cout << "\n";
+  std::print("\n");
   lines_used++;
 
   for (const auto &entry : filtered)
   {
-    std::cout << std::left << std::setw(item_width) << entry;
+    std::print("{:<{}}", entry, item_width);
     if (++items_shown % items_per_row == 0)
     {
-      std::cout << "\n";
+      std::print("\n");
       if (++lines_used == 10)
         break;
     }
@@ -129,7 +130,7 @@ void prompt::display_suggestions_horizontal(const std::vector<std::string> &matc
 
   if (items_shown % items_per_row != 0)
   {
-    std::cout << "\n";
+    std::print("\n");
     ++lines_used;
   }
 }
@@ -141,13 +142,13 @@ void prompt::display_suggestions_vertical_limited(const std::vector<std::string>
 
   for (int i = 0; i < to_show; ++i)
   {
-    std::cout << " " << matches[i] << "\n";
+    std::println(" {}", matches[i]);
     lines_used++;
   }
 
   if ((int)matches.size() > max_lines)
   {
-    std::cout << " ... and " << (matches.size() - max_lines) << " more matches\n";
+    std::println(" ... and {} more matches", matches.size() - max_lines);
     lines_used++;
   }
 }
@@ -157,7 +158,8 @@ std::string prompt::prompt_path(const std::string &prompt, bool use_horizontal)
   termios original;
   enable_raw_mode(original);
   std::string buffer;
-  std::cout << prompt << std::flush;
+  std::print("{}", prompt);
+  std::fflush(stdout);
 
   while (true)
   {
@@ -167,7 +169,7 @@ std::string prompt::prompt_path(const std::string &prompt, bool use_horizontal)
     if (bytes_read == 0 || bytes_read == -1 || c == 4)  // Ctrl+D
     {
       disable_raw_mode(original);
-      std::cout << "\nExiting...\n";
+      std::print("\nExiting...\n");
       exit(0);
     }
 
@@ -213,7 +215,7 @@ std::string prompt::prompt_path(const std::string &prompt, bool use_horizontal)
     redraw_prompt(prompt, buffer);
   }
 
-  std::cout << "\n";
+  std::print("\n");
   disable_raw_mode(original);
   return buffer;
 }
@@ -0,0 +1,218 @@
+#include "./render_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./paths.hpp"
+#include "./utils.hpp"
+
+namespace meow::render_cache
+{
+  static std::size_t limit = 64 * 1024 * 1024;
+
+  void set_limit(std::size_t bytes) noexcept { limit = bytes; }
+  bool enabled() noexcept { return limit > 0; }
+
+  static std::string cache_dir() { return paths::cache_dir() + "/render"; }
+
+  static std::int64_t ns(const timespec &ts) { return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec; }
+
+  static std::string home_dir(const char *xdg, std::string_view fallback)
+  {
+    if (const char *dir = std::getenv(xdg); dir && *dir)
+      return dir;
+    const char *home = std::getenv("HOME");
+    return std::format("{}/{}", home ? home : "", fallback);
+  }
+
+  // Files bat takes defaults, themes and syntaxes from besides its arguments and environment: the system and user
+  // config files and the assets `bat cache --build` writes. Where bat keeps them elsewhere (macOS) they aren't found
+  // and edits there need the cache cleared.
+  static std::vector<std::string> bat_files()
+  {
+    const char *config = std::getenv("BAT_CONFIG_PATH");
+    const char *cache = std::getenv("BAT_CACHE_PATH");
+    const std::string cache_dir = cache && *cache ? cache : home_dir("XDG_CACHE_HOME", ".cache") + "/bat";
+    return {"/etc/bat/config", config && *config ? config : home_dir("XDG_CONFIG_HOME", ".config") + "/bat/config",
+            cache_dir + "/themes.bin", cache_dir + "/syntaxes.bin", cache_dir + "/metadata.yaml"};
+  }
+
+  std::optional<std::string> key_for(const std::string &path, std::string_view backend, const std::vector<std::string> &options, int width)
+  {
+    if (!enabled())
+      return std::nullopt;
+
+    struct stat st{};
+    if (::stat(meow::expand_paths(path).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      return std::nullopt;
+
+    struct stat backend_st{};
+    ::stat(std::string(backend).c_str(), &backend_st);
+
+    std::string key = std::format("render-1|{}|{}|{}|{}|{}|{}|{}|{}|{}", st.st_dev, st.st_ino, st.st_size, ns(st.st_mtim),
+                                  ns(st.st_ctim), path, backend, ns(backend_st.st_mtim), width);
+    for (const auto &opt : options)
+      key += std::format("|{}", opt);
+
+    // What bat looks at besides its arguments
+    for (const char *name : {"BAT_THEME", "BAT_STYLE", "BAT_TABS", "BAT_CONFIG_PATH", "BAT_CACHE_PATH", "COLORTERM", "NO_COLOR"})
+      if (const char *value = std::getenv(name))
+        key += std::format("|{}={}", name, value);
+    if (std::string_view name = backend.substr(backend.rfind('/') + 1); name.contains("bat"))
+      for (const auto &file : bat_files())
+      {
+        struct stat file_st{};
+        key += ::stat(file.c_str(), &file_st) == 0 ? std::format("|{}@{}", file, ns(file_st.st_mtim)) : "";
+      }
+
+    std::ranges::replace(key, '\n', ' ');
+    return key;
+  }
+
+  static std::string entry_path(const std::string &key)
+  {
+    std::uint64_t h = 14695981039346656037ull;
+    for (char c : key)
+      h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return std::format("{}/{:016x}", cache_dir(), h);
+  }
+
+  std::optional<entry> lookup(const std::string &key)
+  {
+    int fd = ::open(entry_path(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return std::nullopt;
+
+    const std::string header = key + '\n';
+    std::string found(header.size(), '\0');
+    struct stat st{};
+    if (::pread(fd, found.data(), found.size(), 0) != static_cast<ssize_t>(found.size()) || found != header ||
+        ::fstat(fd, &st) != 0)
+    {
+      ::close(fd);
+      return std::nullopt;
+    }
+
+    // The mtime of an entry is its last use
+    ::futimens(fd, nullptr);
+    return entry{fd, static_cast<off_t>(header.size()), static_cast<std::size_t>(st.st_size) - header.size()};
+  }
+
+  // For outputs sendfile can't write to
+  static bool copy(int in_fd, off_t offset, std::size_t left, int out_fd)
+  {
+    char buf[64 * 1024];
+    while (left > 0)
+    {
+      ssize_t n = ::pread(in_fd, buf, std::min(left, sizeof(buf)), offset);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0 || !meow::write_all(out_fd, std::string_view(buf, static_cast<std::size_t>(n))))
+        return false;
+      offset += n;
+      left -= static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  bool send(entry e, int out_fd)
+  {
+    std::size_t left = e.size;
+    off_t offset = e.offset;
+    bool ok = true;
+    while (ok && left > 0)
+    {
+      ssize_t n = ::sendfile(out_fd, e.fd, &offset, left);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+      {
+        ok = copy(e.fd, offset, left, out_fd);
+        break;
+      }
+      ok = n > 0;
+      if (ok)
+        left -= static_cast<std::size_t>(n);
+    }
+    ::close(e.fd);
+    return ok;
+  }
+
+  // Drops the least recently used entries until the cache fits its limit
+  static void evict()
+  {
+    struct cached
+    {
+      std::int64_t used;
+      std::uintmax_t size;
+      std::filesystem::path path;
+    };
+
+    std::vector<cached> entries;
+    std::uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto &dirent : std::filesystem::directory_iterator(cache_dir(), ec))
+    {
+      struct stat st{};
+      if (dirent.path().filename().string().starts_with('.') || ::stat(dirent.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        continue;
+      entries.push_back({ns(st.st_mtim), static_cast<std::uintmax_t>(st.st_size), dirent.path()});
+      total += static_cast<std::uintmax_t>(st.st_size);
+    }
+    if (total <= limit)
+      return;
+
+    std::ranges::sort(entries, {}, &cached::used);
+    for (const auto &e : entries)
+    {
+      if (total <= limit)
+        break;
+      if (std::filesystem::remove(e.path, ec))
+        total -= e.size;
+    }
+  }
+
+  std::size_t capacity(const std::string &key) noexcept
+  {
+    const std::size_t header = key.size() + 1;
+    return limit > header ? limit - header : 0;
+  }
+
+  void store(const std::string &key, std::string_view rendered)
+  {
+    const std::string header = key + '\n';
+    if (!enabled() || rendered.size() > capacity(key))
+      return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir(), ec);
+    if (ec)
+      return;
+
+    // Written aside and renamed into place: readers see a whole entry or none
+    std::string temp = cache_dir() + "/.tmpXXXXXX";
+    int fd = ::mkostemp(temp.data(), O_CLOEXEC);
+    if (fd < 0)
+      return;
+    bool written = meow::write_all(fd, header) && meow::write_all(fd, rendered);
+    ::close(fd);
+    if (!written || ::rename(temp.c_str(), entry_path(key).c_str()) != 0)
+    {
+      ::unlink(temp.c_str());
+      return;
+    }
+
+    evict();
+  }
+}  // namespace meow::render_cache
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+/* Render cache
+ *
+ * NOTE: Whatever a backend printed for a file is kept in $XDG_CACHE_HOME/meow/render/, one file per rendering, named
+ *  by a hash of what it depends on: the file (device, inode, size, mtime, ctime), the backend binary and its mtime,
+ *  the options, the terminal width, the environment bat reads its theme and style from and, for bat, the mtimes of
+ *  its config files and theme/syntax cache. Each entry starts with the full key on its own line, so a hash collision
+ *  is a miss, never wrong output.
+ *
+ *  A hit is copied to the output with sendfile(2) and touched, and the cache is kept under its size limit by
+ *  dropping the least recently used entries whenever one is added. Only complete renders of backends that exited
+ *  successfully are stored, and only while they fit the limit: callers stop copying a render as soon as it outgrows
+ *  `capacity`, so a huge file streams through without being held in memory.
+ */
+
+namespace meow::render_cache
+{
+  // 0 disables the cache, the default is 64MiB
+  void set_limit(std::size_t bytes) noexcept;
+  [[nodiscard]] bool enabled() noexcept;
+
+  // Nothing when the cache is off or the file can't be stat'ed
+  [[nodiscard]] std::optional<std::string> key_for(const std::string &path, std::string_view backend,
+                                                   const std::vector<std::string> &options, int width);
+
+  // An open entry, positioned at the rendered bytes
+  struct entry
+  {
+    int fd = -1;
+    off_t offset = 0;
+    std::size_t size = 0;
+  };
+
+  [[nodiscard]] std::optional<entry> lookup(const std::string &key);
+
+  // Copies the rendered bytes of the entry to `out_fd` and closes it
+  bool send(entry e, int out_fd);
+
+  // The most rendered bytes an entry under `key` can hold, 0 when the cache is off
+  [[nodiscard]] std::size_t capacity(const std::string &key) noexcept;
+
+  // Best effort, a cache that can't be written just misses next time
+  void store(const std::string &key, std::string_view rendered);
+}  // namespace meow::render_cache
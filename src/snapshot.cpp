@@ -0,0 +1,427 @@
+#include "./snapshot.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./index.hpp"
+#include "./journal.hpp"
+#include "./json_lazy.hpp"
+#include "./utils.hpp"
+
+namespace meow
+{
+  static_assert(sizeof(snapshot::header) == 96, "snapshot header layout changed");
+  static_assert(sizeof(snapshot::record) == 16, "snapshot record layout changed");
+  static_assert(sizeof(snapshot::slot) == 16, "snapshot slot layout changed");
+
+  static std::uint64_t fnv1a(const char *data, std::size_t size)
+  {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static std::uint64_t header_checksum(snapshot::header h)
+  {
+    h.header_checksum = 0;
+    return fnv1a(reinterpret_cast<const char *>(&h), sizeof(h));
+  }
+
+  // Bytes of the payload taken by the records and slots, everything before the string blob
+  static std::uint64_t index_size(const snapshot::header &h)
+  {
+    return (static_cast<std::uint64_t>(h.file_count) + h.alias_count) * sizeof(snapshot::record)
+         + (static_cast<std::uint64_t>(h.file_slots) + h.alias_slots) * sizeof(snapshot::slot);
+  }
+
+  static std::int64_t mtime_ns(const struct stat &st)
+  {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+  }
+
+  // The fields of the header that tie a snapshot to one state of the JSON file and its journal
+  static snapshot::header key_for(const struct stat &json_st, const std::string &json_path)
+  {
+    snapshot::header key{};
+    key.json_mtime_ns = mtime_ns(json_st);
+    key.json_size = static_cast<std::uint64_t>(json_st.st_size);
+    key.json_inode = static_cast<std::uint64_t>(json_st.st_ino);
+
+    struct stat st{};
+    if (::stat(journal::path_for(json_path).c_str(), &st) == 0)
+    {
+      key.journal_inode = static_cast<std::uint64_t>(st.st_ino);
+      key.journal_offset = static_cast<std::uint64_t>(st.st_size);
+    }
+    return key;
+  }
+
+  // Whether the snapshot still reflects the journal: the same one, and nothing past its offset that changes names
+  static bool covers_journal(const snapshot::header &h, const std::string &json_path)
+  {
+    struct stat st{};
+    if (::stat(journal::path_for(json_path).c_str(), &st) != 0)
+      return h.journal_inode == 0;
+    if (h.journal_inode != static_cast<std::uint64_t>(st.st_ino) || h.journal_offset > static_cast<std::uint64_t>(st.st_size))
+      return false;
+    if (h.journal_offset == static_cast<std::uint64_t>(st.st_size))
+      return true;
+
+    auto changed = journal::names_changed(json_path, h.journal_inode, h.journal_offset);
+    return changed && !*changed;
+  }
+
+  static std::optional<snapshot::header> key_for(const std::string &json_path)
+  {
+    struct stat st{};
+    if (::stat(json_path.c_str(), &st) != 0)
+      return std::nullopt;
+    return key_for(st, json_path);
+  }
+
+  snapshot::~snapshot()
+  {
+    if (map)
+      ::munmap(map, map_size);
+  }
+
+  snapshot::snapshot(snapshot &&other) noexcept { *this = std::move(other); }
+
+  snapshot &snapshot::operator=(snapshot &&other) noexcept
+  {
+    if (this == &other)
+      return *this;
+
+    if (map)
+      ::munmap(map, map_size);
+
+    map = std::exchange(other.map, nullptr);
+    map_size = std::exchange(other.map_size, 0);
+    bool was_owned = other.base && other.base == other.owned.data();
+    owned = std::move(other.owned);
+    base = was_owned ? owned.data() : other.base;
+    other.base = nullptr;
+    return *this;
+  }
+
+  std::string snapshot::path_for(const std::string &json_path)
+  {
+    return std::filesystem::path(json_path).replace_extension(".snap").string();
+  }
+
+  const snapshot::slot *snapshot::slots() const noexcept
+  {
+    return reinterpret_cast<const slot *>(base + sizeof(header) + (head().file_count + head().alias_count) * sizeof(record));
+  }
+
+  std::size_t snapshot::blob_offset() const noexcept { return index_size(head()); }
+
+  const char *snapshot::blob() const noexcept { return base + sizeof(header) + blob_offset(); }
+
+  std::string_view snapshot::string_at(std::uint32_t offset, std::uint32_t length) const noexcept
+  {
+    const std::size_t blob_size = head().payload_size - blob_offset();
+    if (offset > blob_size || length > blob_size - offset)
+      return {};
+    return std::string_view(blob() + offset, length);
+  }
+
+  snapshot_file snapshot::file(std::size_t i) const noexcept
+  {
+    const record &r = records()[i];
+    return {string_at(r.first_offset, r.first_length), string_at(r.second_offset, r.second_length)};
+  }
+
+  snapshot_alias snapshot::alias(std::size_t i) const noexcept
+  {
+    const record &r = records()[head().file_count + i];
+    return {string_at(r.first_offset, r.first_length), string_at(r.second_offset, r.second_length)};
+  }
+
+  const snapshot::slot *snapshot::probe(const slot *table, std::uint32_t count, std::string_view key, bool is_alias) const noexcept
+  {
+    if (count == 0)
+      return nullptr;
+
+    const std::uint32_t h = name_index::hash(key);
+    const std::uint32_t records = is_alias ? head().alias_count : head().file_count;
+    for (std::uint32_t i = h & (count - 1), n = 0; n < count; i = (i + 1) & (count - 1), ++n)
+    {
+      const slot &s = table[i];
+      if (s.key == NONE || s.key >= records)
+        return nullptr;
+      if (s.hash == h && (is_alias ? alias(s.key).alias : file(s.key).name) == key)
+        return &s;
+    }
+    return nullptr;
+  }
+
+  std::optional<std::string_view> snapshot::find_file(std::string_view name) const noexcept
+  {
+    if (const slot *s = probe(slots(), head().file_slots, name, false))
+      return file(s->key).path;
+    return std::nullopt;
+  }
+
+  std::optional<std::string_view> snapshot::find_alias(std::string_view name) const noexcept
+  {
+    if (const slot *s = probe(slots() + head().file_slots, head().alias_slots, name, true))
+      return alias(s->key).file;
+    return std::nullopt;
+  }
+
+  std::optional<snapshot_file> snapshot::resolve(std::string_view name, bool aliases_first) const noexcept
+  {
+    auto by_alias = [&]() -> std::optional<std::optional<snapshot_file>>
+    {
+      const slot *s = probe(slots() + head().file_slots, head().alias_slots, name, true);
+      if (!s)
+        return std::nullopt;
+      if (s->target >= file_count())
+        return std::optional<snapshot_file>{};
+      return file(s->target);
+    };
+
+    auto by_name = [&]() -> std::optional<snapshot_file>
+    {
+      if (const slot *s = probe(slots(), head().file_slots, name, false))
+        return file(s->key);
+      return std::nullopt;
+    };
+
+    if (aliases_first)
+    {
+      // An alias to a file that isn't registered doesn't fall back to a file of the same name
+      if (auto target = by_alias())
+        return *target;
+      return by_name();
+    }
+
+    if (auto f = by_name())
+      return f;
+    return by_alias().value_or(std::nullopt);
+  }
+
+  std::string snapshot::build(const std::vector<jsn::value> &files, const std::vector<jsn::value> &aliases, const header &key)
+  {
+    std::string strings;
+    std::string payload;
+    payload.reserve((files.size() + aliases.size()) * sizeof(record));
+
+    auto add_string = [&](const jsn::value &entry, std::string_view member, std::uint32_t &offset, std::uint32_t &length)
+    {
+      std::string_view str = member_string(entry, member);
+      offset = static_cast<std::uint32_t>(strings.size());
+      length = static_cast<std::uint32_t>(str.size());
+      strings.append(str);
+    };
+
+    auto add_records = [&](const std::vector<jsn::value> &entries, std::string_view first, std::string_view second)
+    {
+      for (const auto &entry : entries)
+      {
+        record r{};
+        add_string(entry, first, r.first_offset, r.first_length);
+        add_string(entry, second, r.second_offset, r.second_length);
+        payload.append(reinterpret_cast<const char *>(&r), sizeof(r));
+      }
+    };
+
+    add_records(files, "name", "path");
+    add_records(aliases, "alias", "file");
+
+    // Hash tables at most half full
+    auto table_size = [](std::size_t entries) -> std::uint32_t
+    {
+      std::uint32_t size = entries == 0 ? 0 : 2;
+      while (size != 0 && size < entries * 2) size <<= 1;
+      return size;
+    };
+
+    const name_index index(files, aliases);
+    auto add_table = [&](std::size_t entries, std::uint32_t size, auto &&key_of, auto &&is_first, auto &&target_of)
+    {
+      std::vector<slot> table(size, slot{0, NONE, NONE, 0});
+      for (std::size_t i = 0; i < entries; ++i)
+      {
+        if (!is_first(i))
+          continue;
+
+        const std::uint32_t h = name_index::hash(key_of(i));
+        std::uint32_t pos = h & (size - 1);
+        while (table[pos].key != NONE) pos = (pos + 1) & (size - 1);
+        table[pos] = slot{h, static_cast<std::uint32_t>(i), target_of(i), 0};
+      }
+      payload.append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(slot));
+    };
+
+    auto file_name = [&](std::size_t i) { return member_string(files[i], "name"); };
+    auto alias_name = [&](std::size_t i) { return member_string(aliases[i], "alias"); };
+    const std::uint32_t file_slots = table_size(files.size());
+    const std::uint32_t alias_slots = table_size(aliases.size());
+
+    add_table(files.size(), file_slots, file_name,
+              [&](std::size_t i) { return index.file(file_name(i)) == i; },
+              [](std::size_t i) { return static_cast<std::uint32_t>(i); });
+    add_table(aliases.size(), alias_slots, alias_name,
+              [&](std::size_t i) { return index.alias(alias_name(i)) == i; },
+              [&](std::size_t i) { return index.alias_target(i) ? static_cast<std::uint32_t>(*index.alias_target(i)) : NONE; });
+
+    const std::uint64_t index_checksum = fnv1a(payload.data(), payload.size());
+    payload.append(strings);
+
+    header h = key;
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.header_size = sizeof(header);
+    h.payload_size = payload.size();
+    h.index_checksum = index_checksum;
+    h.file_count = static_cast<std::uint32_t>(files.size());
+    h.alias_count = static_cast<std::uint32_t>(aliases.size());
+    h.file_slots = file_slots;
+    h.alias_slots = alias_slots;
+    h.header_checksum = header_checksum(h);
+
+    std::string out(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.append(payload);
+    return out;
+  }
+
+  // Validates the header and the index against the state of the JSON file, the blob's strings are bounds checked on
+  // access instead and the journal is looked at separately
+  static bool is_valid(const char *data, std::size_t size, const snapshot::header &key)
+  {
+    if (size < sizeof(snapshot::header))
+      return false;
+
+    snapshot::header h;
+    std::memcpy(&h, data, sizeof(h));
+
+    return std::memcmp(h.magic, snapshot::MAGIC, sizeof(h.magic)) == 0
+        && h.version == snapshot::VERSION
+        && h.header_size == sizeof(snapshot::header)
+        && h.header_checksum == header_checksum(h)
+        && h.json_mtime_ns == key.json_mtime_ns
+        && h.json_size == key.json_size
+        && h.json_inode == key.json_inode
+        && h.payload_size == size - sizeof(snapshot::header)
+        && (h.file_slots & (h.file_slots - 1)) == 0
+        && (h.alias_slots & (h.alias_slots - 1)) == 0
+        && index_size(h) <= h.payload_size
+        && h.index_checksum == fnv1a(data + sizeof(h), index_size(h));
+  }
+
+  static const jsn::array_type &array_of(const jsn::value &data, std::string_view member)
+  {
+    static const jsn::array_type empty;
+    const jsn::value *v = data.find(member);
+    const jsn::array_type *arr = v ? v->get_if<jsn::array_type>() : nullptr;
+    return arr ? *arr : empty;
+  }
+
+  std::expected<void, std::string> snapshot::store(const std::string &json_path, const jsn::value &data)
+  {
+    auto key = key_for(json_path);
+    if (!key)
+      return std::unexpected(std::format("Failed to stat {}", json_path));
+
+    return meow::write_file(path_for(json_path), build(array_of(data, "files"), array_of(data, "aliases"), *key));
+  }
+
+  bool snapshot::extend(const std::string &json_path, std::uint64_t from, std::uint64_t to)
+  {
+    auto key = key_for(json_path);
+    if (!key)
+      return false;
+
+    int fd = ::open(path_for(json_path).c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    // Readers with the old header mapped see either one or a header that fails its checksum and rebuild
+    header h;
+    bool ok = ::pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h))
+           && std::memcmp(h.magic, MAGIC, sizeof(h.magic)) == 0 && h.version == VERSION
+           && h.header_checksum == header_checksum(h)
+           && h.json_mtime_ns == key->json_mtime_ns && h.json_size == key->json_size && h.json_inode == key->json_inode
+           && h.journal_inode == key->journal_inode && h.journal_offset == from && key->journal_offset == to;
+    if (ok)
+    {
+      h.journal_offset = to;
+      h.header_checksum = header_checksum(h);
+      ok = ::pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h));
+    }
+    ::close(fd);
+    return ok;
+  }
+
+  snapshot snapshot::from_data(const jsn::value &data)
+  {
+    snapshot snap;
+    snap.owned = build(array_of(data, "files"), array_of(data, "aliases"), header{});
+    snap.base = snap.owned.data();
+    return snap;
+  }
+
+  std::expected<snapshot, std::string> snapshot::load(const std::string &json_path)
+  {
+    const std::string snap_path = path_for(json_path);
+
+    auto key = key_for(json_path);
+    if (key)
+    {
+      int fd = ::open(snap_path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd >= 0)
+      {
+        struct stat snap_st{};
+        void *mapped = MAP_FAILED;
+        if (::fstat(fd, &snap_st) == 0 && snap_st.st_size > 0)
+          mapped = ::mmap(nullptr, snap_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapped != MAP_FAILED)
+        {
+          snapshot snap;
+          snap.map = mapped;
+          snap.map_size = snap_st.st_size;
+          snap.base = static_cast<const char *>(mapped);
+          if (is_valid(snap.base, snap.map_size, *key) && covers_journal(snap.head(), json_path))
+            return snap;
+        }
+      }
+    }
+
+    // Missing, stale or damaged: rebuild from the JSON and the journal. The journal is stat'ed before it is replayed,
+    // so records appended in between are both in the snapshot and past its offset: they make it stale, never wrong.
+    jsn::lazy_document doc;
+    struct stat json_st{};
+    if (!meow::get_lazy_json(json_path, doc, &json_st))
+      return std::unexpected(std::format("Failed to load {}", json_path));
+    key = key_for(json_st, json_path);
+
+    jsn::value data = jsn::object_type{{"files", meow::ensure_array(doc, "files")}, {"aliases", meow::ensure_array(doc, "aliases")}};
+    journal::replay(json_path, json_st, data, false);
+
+    snapshot snap;
+    snap.owned = build(data["files"].as_array(), data["aliases"].as_array(), *key);
+    snap.base = snap.owned.data();
+
+    // Not being able to cache it isn't fatal, this run just uses the in-memory copy
+    (void)meow::write_file(snap_path, snap.owned);
+    return snap;
+  }
+}  // namespace meow
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./json.hpp"
+
+/* Binary snapshot of the data file
+ *
+ * NOTE: `data.snap` sits next to `data.json` and holds the registered files and aliases in an offset-addressed layout
+ *  that is used straight out of an mmap, so read-only commands don't parse any JSON. It is keyed to the inode, size
+ *  and mtime of the JSON file, and to the inode of its journal (see journal.hpp) and how many bytes of it were folded
+ *  in. Records appended after that offset only make it stale when they touch files or aliases; todo changes leave it
+ *  in use, and committing them just moves the offset forward. It is rebuilt from the JSON and the journal whenever it
+ *  is stale or fails its checks.
+ *
+ *  Layout: header | file records | alias records | file slots | alias slots | string blob.
+ *  Records are pairs of (offset, length) into the blob. Slots are open-addressing hash tables (linear probing, power
+ *  of two sizes) over file names and aliases; alias slots also carry the file they point to, resolved at build time,
+ *  so any name or alias is found with a single probe sequence.
+ *
+ *  Loading checks the header and the index (records and slots, 64 bytes or so per file) against their checksums, so
+ *  it doesn't page in the names and paths. The string blob has no checksum of its own: every string is bounds checked
+ *  against it on access, and a snapshot only ever replaces the previous one whole (write_file renames it in place).
+ */
+
+namespace meow
+{
+  struct snapshot_file
+  {
+    std::string_view name;
+    std::string_view path;
+  };
+
+  struct snapshot_alias
+  {
+    std::string_view alias;
+    std::string_view file;
+  };
+
+  class snapshot
+  {
+  public:
+    static constexpr char MAGIC[8] = {'M', 'E', 'O', 'W', 'S', 'N', 'A', 'P'};
+    static constexpr std::uint32_t VERSION = 7;
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+
+    struct header
+    {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t header_size;
+      std::int64_t json_mtime_ns;
+      std::uint64_t json_size;
+      std::uint64_t json_inode;
+      std::uint64_t journal_inode;   // Both zero while there is no journal
+      std::uint64_t journal_offset;  // Bytes of the journal replayed into the snapshot
+      std::uint64_t payload_size;
+      std::uint64_t header_checksum;  // FNV-1a over the header, with this field zeroed
+      std::uint64_t index_checksum;   // FNV-1a over the payload up to the string blob
+      std::uint32_t file_count;
+      std::uint32_t alias_count;
+      std::uint32_t file_slots;
+      std::uint32_t alias_slots;
+    };
+
+    struct record
+    {
+      std::uint32_t first_offset;
+      std::uint32_t first_length;
+      std::uint32_t second_offset;
+      std::uint32_t second_length;
+    };
+
+    struct slot
+    {
+      std::uint32_t hash;
+      std::uint32_t key;     // Record the key belongs to, NONE for an empty slot
+      std::uint32_t target;  // File record it resolves to, NONE for an alias to an unregistered file
+      std::uint32_t reserved;
+    };
+
+  private:
+    void *map = nullptr;
+    std::size_t map_size = 0;
+    std::string owned;  // Used instead of the mapping when the snapshot couldn't be written out
+    const char *base = nullptr;
+
+    [[nodiscard]] const header &head() const noexcept { return *reinterpret_cast<const header *>(base); }
+    [[nodiscard]] const record *records() const noexcept { return reinterpret_cast<const record *>(base + sizeof(header)); }
+    [[nodiscard]] const slot *slots() const noexcept;
+    [[nodiscard]] const char *blob() const noexcept;
+    [[nodiscard]] std::size_t blob_offset() const noexcept;
+    [[nodiscard]] const slot *probe(const slot *table, std::uint32_t count, std::string_view key, bool is_alias) const noexcept;
+    [[nodiscard]] std::string_view string_at(std::uint32_t offset, std::uint32_t length) const noexcept;
+
+  public:
+    snapshot() = default;
+    ~snapshot();
+    snapshot(const snapshot &) = delete;
+    snapshot &operator=(const snapshot &) = delete;
+    snapshot(snapshot &&other) noexcept;
+    snapshot &operator=(snapshot &&other) noexcept;
+
+    // Maps the snapshot for `json_path`, rebuilding it first if it is missing, stale or damaged
+    [[nodiscard]] static std::expected<snapshot, std::string> load(const std::string &json_path);
+
+    // Serialises files/aliases into the snapshot format, keyed to the given state of the JSON file
+    [[nodiscard]] static std::string build(const std::vector<jsn::value> &files, const std::vector<jsn::value> &aliases,
+                                           const header &key);
+
+    // Rewrites the snapshot from already loaded data, for commands that just changed it
+    static std::expected<void, std::string> store(const std::string &json_path, const jsn::value &data);
+
+    // Marks a current snapshot that covered the journal up to `from` as covering it up to `to`, for commits that left
+    // files and aliases alone. Only the header is rewritten; false when the snapshot wasn't current to begin with.
+    static bool extend(const std::string &json_path, std::uint64_t from, std::uint64_t to);
+
+    // In-memory snapshot of data that hasn't been committed yet, nothing is written
+    [[nodiscard]] static snapshot from_data(const jsn::value &data);
+
+    [[nodiscard]] static std::string path_for(const std::string &json_path);
+
+    [[nodiscard]] std::size_t file_count() const noexcept { return head().file_count; }
+    [[nodiscard]] std::size_t alias_count() const noexcept { return head().alias_count; }
+    [[nodiscard]] snapshot_file file(std::size_t i) const noexcept;
+    [[nodiscard]] snapshot_alias alias(std::size_t i) const noexcept;
+
+    [[nodiscard]] std::optional<std::string_view> find_file(std::string_view name) const noexcept;
+    [[nodiscard]] std::optional<std::string_view> find_alias(std::string_view alias) const noexcept;
+    // Name or alias to the registered file, by default an alias shadows a file of the same name
+    [[nodiscard]] std::optional<snapshot_file> resolve(std::string_view name, bool aliases_first = true) const noexcept;
+  };
+}  // namespace meow
@@ -0,0 +1,137 @@
+#include "./stats.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <format>
+#include <map>
+#include <print>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "./json.hpp"
+#include "./utils.hpp"
+
+namespace meow::stats
+{
+  struct sample
+  {
+    std::string name;
+    double wall_ms = 0;
+    double user_ms = 0;
+    double sys_ms = 0;
+    long max_rss_kb = 0;
+    long voluntary_switches = 0;
+    long involuntary_switches = 0;
+    int exit_status = 0;  // -signal when killed, always 0 for in-process work
+  };
+
+  struct started_process
+  {
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  static bool printing = false;
+  static std::string command_name;
+  static std::map<pid_t, started_process> running;
+
+  static const char *metrics_file()
+  {
+    const char *path = std::getenv("MEOW_METRICS_FILE");
+    return path && *path ? path : nullptr;
+  }
+
+  bool enabled() noexcept { return printing || metrics_file(); }
+
+  void print_to_stderr() { printing = true; }
+
+  void set_command(std::string_view command) { command_name = command; }
+
+  static double ms(const timeval &tv) { return tv.tv_sec * 1e3 + tv.tv_usec / 1e3; }
+
+  static void report(const sample &s)
+  {
+    if (printing)
+      std::println(stderr, "[STATS]: {:<10} wall {:8.2f}ms  user {:8.2f}ms  sys {:8.2f}ms  max-rss {:>7}KB  ctx {}/{}  exit {}", s.name,
+                   s.wall_ms, s.user_ms, s.sys_ms, s.max_rss_kb, s.voluntary_switches, s.involuntary_switches, s.exit_status);
+
+    const char *path = metrics_file();
+    if (!path)
+      return;
+
+    jsn::value line = jsn::object_type{
+      {"time", static_cast<double>(std::time(nullptr))},
+      {"command", command_name},
+      {"name", s.name},
+      {"wall_ms", s.wall_ms},
+      {"user_ms", s.user_ms},
+      {"sys_ms", s.sys_ms},
+      {"max_rss_kb", static_cast<double>(s.max_rss_kb)},
+      {"voluntary_switches", static_cast<double>(s.voluntary_switches)},
+      {"involuntary_switches", static_cast<double>(s.involuntary_switches)},
+      {"exit_status", static_cast<double>(s.exit_status)},
+    };
+
+    // One O_APPEND write per line, so concurrent meows never interleave within a line
+    int fd = ::open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || !meow::write_all(fd, jsn::to_string(line) + "\n"))
+      std::println(stderr, "[WARNING]: Couldn't write metrics to {}", path);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  void process_started(pid_t pid, std::string_view name, std::chrono::steady_clock::time_point start)
+  {
+    if (enabled())
+      running[pid] = {std::string(name), start};
+  }
+
+  void process_finished(pid_t pid, int status, const struct rusage &usage)
+  {
+    auto it = running.find(pid);
+    if (it == running.end())
+      return;
+
+    sample s;
+    s.name = std::move(it->second.name);
+    s.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - it->second.start).count();
+    s.user_ms = ms(usage.ru_utime);
+    s.sys_ms = ms(usage.ru_stime);
+    s.max_rss_kb = usage.ru_maxrss;
+    s.voluntary_switches = usage.ru_nvcsw;
+    s.involuntary_switches = usage.ru_nivcsw;
+    s.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : WIFSIGNALED(status) ? -WTERMSIG(status) : 0;
+    running.erase(it);
+
+    report(s);
+  }
+
+  scope::scope(std::string_view name) : name(name)
+  {
+    if (!enabled())
+      return;
+    start = std::chrono::steady_clock::now();
+    ::getrusage(RUSAGE_SELF, &usage_start);
+  }
+
+  scope::~scope()
+  {
+    if (!enabled())
+      return;
+
+    struct rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+
+    sample s;
+    s.name = name;
+    s.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    s.user_ms = ms(usage.ru_utime) - ms(usage_start.ru_utime);
+    s.sys_ms = ms(usage.ru_stime) - ms(usage_start.ru_stime);
+    s.max_rss_kb = usage.ru_maxrss;
+    s.voluntary_switches = usage.ru_nvcsw - usage_start.ru_nvcsw;
+    s.involuntary_switches = usage.ru_nivcsw - usage_start.ru_nivcsw;
+    report(s);
+  }
+}  // namespace meow::stats
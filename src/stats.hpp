@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/* Resource accounting
+ *
+ * NOTE: With `meow --stats <command>` every spawned backend (bat, cat, the editor) and the built-in pager report
+ *  wall time, user/system CPU time, max RSS and context switches on stderr when they finish. With
+ *  MEOW_METRICS_FILE=<path> the same samples are appended to that file as one JSON object per line, so runs on many
+ *  machines can be collected and compared. Without either, nothing is measured.
+ *
+ *  Spawned processes are measured with wait4(2). In-process work (the built-in pager) is measured as the difference
+ *  of getrusage(RUSAGE_SELF) around it; its max RSS is that of the whole meow process.
+ */
+
+namespace meow::stats
+{
+  [[nodiscard]] bool enabled() noexcept;
+
+  // `--stats`: print samples on stderr
+  void print_to_stderr();
+
+  // Names the command samples are attributed to in the metrics file
+  void set_command(std::string_view command);
+
+  // Remembers when `pid` was started (taken before spawning it), for its wall time
+  void process_started(pid_t pid, std::string_view name, std::chrono::steady_clock::time_point start);
+  void process_finished(pid_t pid, int status, const struct rusage &usage);
+
+  // Measures the work done during its lifetime in this process
+  class scope
+  {
+  private:
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    struct rusage usage_start{};
+
+  public:
+    explicit scope(std::string_view name);
+    ~scope();
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+  };
+}  // namespace meow::stats
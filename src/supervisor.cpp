@@ -0,0 +1,293 @@
+#include "./supervisor.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <iterator>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "./stats.hpp"
+
+namespace meow
+{
+  // Shared with the signal handlers: the groups signals are forwarded to (0 marks a free slot) and the self-pipe
+  static constexpr std::size_t MAX_GROUPS = 256;
+  static volatile std::sig_atomic_t groups[MAX_GROUPS];
+  static volatile std::sig_atomic_t received_signal = 0;
+  static int wake[2] = {-1, -1};
+
+  static constexpr int HANDLED[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGCHLD};
+  static struct sigaction previous[std::size(HANDLED)];
+  static bool installed[std::size(HANDLED)];
+
+  static void on_signal(int sig)
+  {
+    const int saved_errno = errno;
+    if (sig != SIGCHLD)
+    {
+      for (auto &group : groups)
+        if (group > 0)
+          ::kill(-group, sig);
+
+      // Anything but Ctrl-C ends meow as it would have without a supervisor, once the handler returns
+      if (sig != SIGINT)
+      {
+        ::signal(sig, SIG_DFL);
+        ::raise(sig);
+      }
+      received_signal = sig;
+    }
+    char byte = 0;
+    [[maybe_unused]] ssize_t n = ::write(wake[1], &byte, 1);
+    errno = saved_errno;
+  }
+
+  static void add_group(pid_t pgid)
+  {
+    for (auto &group : groups)
+      if (group == 0)
+      {
+        group = pgid;
+        return;
+      }
+  }
+
+  static void remove_group(pid_t pgid)
+  {
+    for (auto &group : groups)
+      if (group == pgid)
+        group = 0;
+  }
+
+  // tcsetpgrp from a background group raises SIGTTOU unless it is blocked
+  static void give_terminal(pid_t pgid)
+  {
+    sigset_t ttou, old;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    ::sigprocmask(SIG_BLOCK, &ttou, &old);
+    ::tcsetpgrp(STDIN_FILENO, pgid);
+    ::sigprocmask(SIG_SETMASK, &old, nullptr);
+  }
+
+  static void signal_group(pid_t pid, int sig)
+  {
+    if (::kill(-pid, sig) != 0)
+      ::kill(pid, sig);
+  }
+
+  supervisor::supervisor()
+  {
+    received_signal = 0;
+    if (::pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0)
+      wake[0] = wake[1] = -1;
+
+    struct sigaction sa{};
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    for (std::size_t i = 0; i < std::size(HANDLED); ++i)
+    {
+      ::sigaction(HANDLED[i], nullptr, &previous[i]);
+      // Signals meow was started ignoring (nohup, `&` in scripts) stay ignored
+      installed[i] = HANDLED[i] == SIGCHLD || previous[i].sa_handler != SIG_IGN;
+      if (installed[i])
+        ::sigaction(HANDLED[i], &sa, nullptr);
+    }
+  }
+
+  supervisor::~supervisor()
+  {
+    // Nothing outlives its supervisor
+    for (auto &[pid, c] : children)
+      if (!c.status)
+      {
+        signal_group(pid, SIGKILL);
+        struct rusage usage{};
+        int status = 0;
+        if (::wait4(pid, &status, 0, &usage) == pid)
+          meow::stats::process_finished(pid, status, usage);
+        remove_group(pid);
+        if (c.pidfd >= 0)
+          ::close(c.pidfd);
+        if (c.foreground)
+          give_terminal(::getpgrp());
+      }
+
+    for (std::size_t i = 0; i < std::size(HANDLED); ++i)
+      if (installed[i])
+        ::sigaction(HANDLED[i], &previous[i], nullptr);
+    for (int &fd : wake)
+      if (fd >= 0)
+      {
+        ::close(fd);
+        fd = -1;
+      }
+
+    if (received_signal == SIGINT)
+      ::raise(SIGINT);
+  }
+
+  void supervisor::adopt(pid_t pid, std::chrono::milliseconds timeout)
+  {
+    child c;
+    c.pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+    c.foreground = ::isatty(STDIN_FILENO) && ::tcgetpgrp(STDIN_FILENO) == pid;
+    if (timeout.count() > 0)
+      c.deadline = std::chrono::steady_clock::now() + timeout;
+
+    // A child left in meow's own group gets the terminal's signals by itself
+    if (::getpgid(pid) == pid)
+      add_group(pid);
+    children.insert_or_assign(pid, c);
+  }
+
+  void supervisor::suspend(pid_t pid)
+  {
+    give_terminal(::getpgrp());
+    ::raise(SIGTSTP);
+
+    // Resumed: by `fg` the child gets the terminal back, by `bg` it keeps running without it
+    if (::tcgetpgrp(STDIN_FILENO) == ::getpgrp())
+      give_terminal(pid);
+    signal_group(pid, SIGCONT);
+  }
+
+  void supervisor::reap(pid_t pid, child &c)
+  {
+    int status = 0;
+    struct rusage usage{};
+    if (::wait4(pid, &status, WNOHANG | WUNTRACED, &usage) != pid)
+      return;
+
+    if (WIFSTOPPED(status))
+    {
+      // A child left in meow's group was stopped along with meow and is continued along with it. One in a background
+      // group of its own (a render) stops only when it touches the terminal, it would never get going again.
+      if (c.foreground)
+        suspend(pid);
+      else if (::getpgid(pid) == pid)
+        signal_group(pid, SIGKILL);
+      return;
+    }
+
+    c.status = status;
+    meow::stats::process_finished(pid, status, usage);
+    remove_group(pid);
+    if (c.pidfd >= 0)
+    {
+      ::close(c.pidfd);
+      c.pidfd = -1;
+    }
+    if (c.foreground)
+    {
+      give_terminal(::getpgrp());
+      // Ctrl-C only reached the child, meow is interrupted all the same
+      if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+        received_signal = SIGINT;
+    }
+  }
+
+  void supervisor::poll(std::span<pollfd> fds, std::optional<std::chrono::milliseconds> max_wait)
+  {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<pollfd> all(fds.begin(), fds.end());
+    if (wake[0] >= 0)
+      all.push_back({wake[0], POLLIN, 0});
+
+    std::optional<clock::time_point> next;
+    for (auto &[pid, c] : children)
+    {
+      if (c.status)
+        continue;
+      if (c.pidfd >= 0)
+        all.push_back({c.pidfd, POLLIN, 0});
+      for (const auto &t : {c.deadline, c.kill_at})
+        if (t && (!next || *t < *next))
+          next = t;
+    }
+
+    int timeout = -1;
+    if (next)
+      timeout = static_cast<int>(std::max<long long>(
+        0, std::chrono::ceil<std::chrono::milliseconds>(*next - clock::now()).count()));
+    if (max_wait && (timeout < 0 || max_wait->count() < timeout))
+      timeout = static_cast<int>(std::max<long long>(0, max_wait->count()));
+
+    const int ready = ::poll(all.data(), all.size(), timeout);
+    for (std::size_t i = 0; i < fds.size(); ++i)
+      fds[i].revents = ready > 0 ? all[i].revents : 0;
+
+    char buf[64];
+    if (wake[0] >= 0)
+      while (::read(wake[0], buf, sizeof(buf)) > 0)
+        ;
+
+    const auto now = clock::now();
+    for (auto &[pid, c] : children)
+    {
+      if (c.status)
+        continue;
+      reap(pid, c);
+      if (c.status)
+        continue;
+
+      if (c.kill_at && now >= *c.kill_at)
+      {
+        signal_group(pid, SIGKILL);
+        c.kill_at.reset();
+      }
+      else if (c.deadline && now >= *c.deadline)
+      {
+        c.timed_out = true;
+        terminate(pid);
+      }
+    }
+  }
+
+  int supervisor::wait(pid_t pid)
+  {
+    while (!status(pid))
+      poll();
+    return *status(pid);
+  }
+
+  std::optional<int> supervisor::status(pid_t pid) const
+  {
+    auto it = children.find(pid);
+    return it == children.end() ? std::nullopt : it->second.status;
+  }
+
+  bool supervisor::timed_out(pid_t pid) const
+  {
+    auto it = children.find(pid);
+    return it != children.end() && it->second.timed_out;
+  }
+
+  void supervisor::terminate(pid_t pid)
+  {
+    auto it = children.find(pid);
+    if (it == children.end() || it->second.status || it->second.kill_at)
+      return;
+
+    signal_group(pid, SIGTERM);
+    signal_group(pid, SIGCONT);
+    it->second.deadline.reset();
+    it->second.kill_at = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  }
+
+  int supervisor::received() noexcept { return received_signal; }
+
+  void supervisor::absorb_interrupt() noexcept
+  {
+    if (received_signal == SIGINT)
+      received_signal = 0;
+  }
+}  // namespace meow
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <span>
+
+#include <poll.h>
+#include <sys/types.h>
+
+/* Child supervision
+ *
+ * NOTE: Backends run in process groups of their own, so meow decides what reaches them. A child spawned as the
+ *  foreground job is handed the terminal: Ctrl-C and Ctrl-Z go to it, and meow takes the terminal back when it exits.
+ *  When it is stopped, meow stops too (so the shell sees the job stopped) and resumes it on `fg`. One that can't be
+ *  handed the terminal stays in meow's group instead, and is stopped and continued along with meow.
+ *
+ *  While a supervisor exists, SIGINT, SIGTERM, SIGHUP and SIGQUIT sent to meow are forwarded to every supervised
+ *  group. SIGINT is then remembered and re-raised once the supervisor is gone (the other ones end meow right away,
+ *  as they did before). Waiting is one poll(2) over a pidfd per child, a self-pipe the signal handlers write to and
+ *  whatever other descriptors the caller needs, with the nearest deadline as its timeout. Without pidfds (kernels
+ *  older than 5.3) children are noticed through SIGCHLD alone.
+ *
+ *  Only one supervisor may exist at a time.
+ */
+
+namespace meow
+{
+  class supervisor
+  {
+  private:
+    struct child
+    {
+      int pidfd = -1;
+      bool foreground = false;
+      std::optional<std::chrono::steady_clock::time_point> deadline;
+      std::optional<std::chrono::steady_clock::time_point> kill_at;  // SIGKILL when SIGTERM wasn't enough
+      std::optional<int> status;                                       // wait(2) status once reaped
+      bool timed_out = false;                                          // Terminated for running out of time
+    };
+
+    std::map<pid_t, child> children;
+
+    void reap(pid_t pid, child &c);
+    void suspend(pid_t pid);
+
+  public:
+    supervisor();
+    ~supervisor();
+    supervisor(const supervisor &) = delete;
+    supervisor &operator=(const supervisor &) = delete;
+
+    // Takes charge of a child started in its own process group. With a timeout it is terminated when that runs out.
+    void adopt(pid_t pid, std::chrono::milliseconds timeout = {});
+
+    // One round of waiting: returns once something happened (a descriptor in `fds` is ready, a child changed state, a
+    // signal arrived or a deadline passed), or after `max_wait`, with the revents of `fds` filled in. A zero `max_wait`
+    // only enforces deadlines, for callers that wait on something else.
+    void poll(std::span<pollfd> fds = {}, std::optional<std::chrono::milliseconds> max_wait = std::nullopt);
+
+    // Waits for the child to finish and returns its wait(2) status
+    int wait(pid_t pid);
+
+    // The wait(2) status of a finished child, nothing while it runs
+    [[nodiscard]] std::optional<int> status(pid_t pid) const;
+
+    // SIGTERM to the child's group now, SIGKILL if it is still there a second later
+    void terminate(pid_t pid);
+
+    // Whether the child was terminated for running out of time
+    [[nodiscard]] bool timed_out(pid_t pid) const;
+
+    // The signal meow received (and forwarded) while supervising, 0 if none
+    [[nodiscard]] static int received() noexcept;
+
+    // Forget a received SIGINT instead of re-raising it, for callers that treat it as "stop loading"
+    static void absorb_interrupt() noexcept;
+  };
+}  // namespace meow
@@ -1,29 +1,54 @@
 #include <string>
 #include <format>
 #include <print>
-#include <iostream>
 #include <stdexcept>
 #include <chrono>
-#include <sstream>
-#include <optional>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
 #include <optional>
 #include <vector>
 
 #include "./utils.hpp"
 #include "./todo.hpp"
-#include "./paths.hpp"
+#include "./journal.hpp"
+#include "./context.hpp"
 #include "./json.hpp"
 
 std::optional<std::chrono::sys_days> parse_date(const std::string &date_str)
 {
-  std::istringstream ss(date_str);
-  std::chrono::year_month_day ymd;
-  ss >> std::chrono::parse("%d/%m/%Y", ymd);
-  if (ss.fail() || !ymd.ok())
+  // dd/mm/yyyy, parsed by hand to keep streams out of the binary
+  const char *it = date_str.data();
+  const char *end = it + date_str.size();
+  int fields[3] = {};
+  for (int i = 0; i < 3; ++i)
+  {
+    auto [next, ec] = std::from_chars(it, end, fields[i]);
+    if (ec != std::errc{} || next == it)
+      return std::nullopt;
+    it = next;
+    if (i < 2 && (it == end || *it++ != '/'))
+      return std::nullopt;
+  }
+  if (fields[0] < 0 || fields[1] < 0)
+    return std::nullopt;
+
+  std::chrono::year_month_day ymd{std::chrono::year{fields[2]}, std::chrono::month{static_cast<unsigned>(fields[1])},
+                                  std::chrono::day{static_cast<unsigned>(fields[0])}};
+  if (!ymd.ok())
     return std::nullopt;
   return std::chrono::sys_days{ymd};
 }
 
+// One line from stdin, without the newline
+static void read_line(std::string &line)
+{
+  std::fflush(stdout);
+  line.clear();
+  for (int c; (c = std::getchar()) != EOF && c != '\n';)
+    line += static_cast<char>(c);
+}
+
 std::string time_left(std::string_view due_date)
 {
   std::chrono::sys_days due = parse_date(due_date.data()).value_or(std::chrono::sys_days{});
@@ -37,7 +62,7 @@ std::string time_left(std::string_view due_date)
   return std::format("{} day{}", days, days == 1 ? "" : "s");
 }
 
-void meow::todo::add(std::vector<std::string> args)
+void meow::todo::add(const std::vector<std::string> &args)
 {
   const int NUM_ARGS = args.size();
   std::string TODO;
@@ -46,12 +71,12 @@ void meow::todo::add(std::vector<std::string> args)
   if (NUM_ARGS == 3)
   {
     std::print("Enter todo: ");
-    std::getline(std::cin, TODO);
+    read_line(TODO);
     if (TODO.empty())
       meow::handle_error("Empty todo entered");
 
     std::print("Enter due-date (dd/mm/yyyy) (optional): ");
-    std::getline(std::cin, raw_due_date);
+    read_line(raw_due_date);
   }
   else if (NUM_ARGS == 4)
   {
@@ -60,11 +85,19 @@ void meow::todo::add(std::vector<std::string> args)
       meow::handle_error("Empty todo string provided");
 
     std::print("Enter due-date (dd/mm/yyyy) (optional): ");
-    std::getline(std::cin, raw_due_date);
+    read_line(raw_due_date);
+  }
+  else if (NUM_ARGS == 5)
+  {
+    // Fully specified, doesn't prompt (scripts, batch)
+    TODO = args[3];
+    raw_due_date = args[4];
+    if (TODO.empty())
+      meow::handle_error("Empty todo string provided");
   }
   else
   {
-    meow::handle_error(std::format("Usage: {} todo add <todo string>", args[0]));
+    meow::handle_error(std::format("Usage: {} todo add <todo string> [dd/mm/yyyy]", args[0]));
     return;
   }
 
@@ -86,25 +119,19 @@ void meow::todo::add(std::vector<std::string> args)
     }
   }
 
-  jsn::value data;
-  if (!meow::get_json(paths::data_path(), data)) return;
-
-  meow::ensure_array(data, "todos");
-
   jsn::value new_todo = jsn::object_type({
     {"todo"    , TODO},
     {"due-date", raw_due_date},
     {"done"    , false}
   });
 
-  auto &todos = data["todos"].ref_array();
-  todos.push_back(new_todo);
+  if (!meow::update_data(meow::context::get().data_path(), [&](jsn::value &, meow::mutation &m) { m.push("todos", new_todo); }))
+    return;
 
-  meow::write_data_or_error(paths::data_path().c_str(), data);
   std::println("Todo added!");
 }
 
-void meow::todo::remove(std::vector<std::string> args)
+void meow::todo::remove(const std::vector<std::string> &args)
 {
   const int NUM_ARGS = args.size();
   if (NUM_ARGS != 4)
@@ -113,75 +140,84 @@ void meow::todo::remove(std::vector<std::string> args)
     return;
   }
 
-  jsn::value data;
-  if (!meow::get_json(paths::data_path(), data))
-    return;
-  meow::ensure_array(data, "todos");
-  auto &todos = data["todos"].ref_array();
-
   std::string token = args[3];
-  bool removed = false;
   std::string todo_str = "";
-  try
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
   {
-    int index = std::stoi(token);
-    if (index < 1 || index > static_cast<int>(todos.size()))
+    auto &todos = meow::ensure_array(data, "todos");
+    bool removed = false;
+    try
     {
-      meow::handle_error("Index out of range");
-      return;
+      int index = std::stoi(token);
+      if (index < 1 || index > static_cast<int>(todos.size()))
+      {
+        meow::handle_error("Index out of range");
+        return;
+      }
+      todo_str = todos[index - 1]["todo"].as_string();
+      m.erase_at("todos", index - 1);
+      removed = true;
     }
-    todo_str = todos[index - 1]["todo"].as_string();
-    todos.erase(todos.begin() + (index - 1));
-    removed = true;
-  }
-  catch (const std::invalid_argument &)
-  {
-    // Not a number: treat as todo string
-    auto it = std::ranges::find_if(todos, [&](const jsn::value &v) { return v["todo"].as_string() == token; });
-    todo_str = token;
-    if (it != todos.end())
+    catch (const std::invalid_argument &)
     {
-      todos.erase(it);
-      removed = true;
+      // Not a number: treat as todo string
+      auto it = std::ranges::find_if(todos, [&](const jsn::value &v) { return v["todo"].as_string() == token; });
+      todo_str = token;
+      if (it != todos.end())
+      {
+        m.erase_at("todos", it - todos.begin());
+        removed = true;
+      }
     }
-  }
 
-  if (!removed)
-  {
-    meow::handle_error("No todo found with that index or description.");
+    if (!removed)
+      meow::handle_error("No todo found with that index or description.");
+  });
+  if (!updated)
     return;
-  }
 
-  meow::write_data_or_error(paths::data_path().c_str(), data);
   std::println("Todo {} removed!", todo_str);
 }
 
-void meow::todo::list(std::vector<std::string> args)
+void meow::todo::list(const std::vector<std::string> &args)
 {
   (void)args; //Will use later maybe
-  jsn::value data;
-  if (!meow::get_json(paths::data_path(), data))
-    return;
 
-  meow::ensure_array(data, "todos");
-  const auto &todos = data["todos"].as_array();
+  // Only the todos are materialised, with whatever the journal changed on top
+  jsn::value data = jsn::object_type{};
+  if (const meow::data_batch *batch = meow::data_batch::current())
+  {
+    if (const jsn::value *todos = batch->data().find("todos"))
+      data = jsn::object_type{{"todos", *todos}};
+  }
+  else
+  {
+    const std::string path = meow::context::get().data_path();
+    jsn::lazy_document doc;
+    struct stat st{};
+    if (!meow::get_lazy_json(path, doc, &st))
+      return;
+
+    data = jsn::object_type{{"todos", meow::ensure_array(doc, "todos")}};
+    meow::journal::replay(path, st, data, false);
+  }
+  const auto &todos = meow::ensure_array(data, "todos");
 
   if (todos.empty())
   {
-    std::cout << "\033[1;34mYour todo list is empty. Time to relax!\033[0m\n";
+    std::print("\033[1;34mYour todo list is empty. Time to relax!\033[0m\n");
     return;
   }
 
-  std::cout << "\n\033[1;33m───────────────────────────── 󱙵  Your todos 󱙵  ─────────────────────────────\033[0m\n\n";
+  std::print("\n\033[1;33m───────────────────────────── 󱙵  Your todos 󱙵  ─────────────────────────────\033[0m\n\n");
 
   int index = 1;
   for (int i = 0; i < (int)todos.size(); ++i)
   {
-    auto item = todos[i];
-    const auto &obj = item.as_object();
+    const auto &obj = todos[i].as_object();
 
-    std::string text = obj.at("todo").as_string();
-    std::string due_date = obj.at("due-date").as_string();
+    const std::string &text = obj.at("todo").as_string();
+    const std::string &due_date = obj.at("due-date").as_string();
     bool done = obj.at("done").as_boolean();
     std::string checkbox = done ? "\033[1;32m[✓]\033[0m" : "\033[1;31m[ ]\033[0m";
 
@@ -193,20 +229,20 @@ void meow::todo::list(std::vector<std::string> args)
     bool invalid_time = (timeleft == "invalid date");
 
     if (i == 0)
-      std::cout << " \033[2m  ┌─────────────────────────────────────────────────────────────\033[0m\n";
+      std::print(" \033[2m  ┌─────────────────────────────────────────────────────────────\033[0m\n");
 
-    std::cout << " \033[2m\033[0m " << std::setw(2) << index++ << ". " << checkbox << " " << styled_text << "\n";
+    std::print(" \033[2m\033[0m {:>2}. {} {}\n", index++, checkbox, styled_text);
 
-    std::cout << " \033[2m\033[0m           \033[34mdue-date :\033[0m " << due_date << "\n";
+    std::print(" \033[2m\033[0m           \033[34mdue-date :\033[0m {}\n", due_date);
 
-    std::cout << " \033[2m\033[0m           \033[34mtime-left:\033[0m " << (invalid_time ? "\033[2;31minvalid date\033[0m" : timeleft) << "\n";
+    std::print(" \033[2m\033[0m           \033[34mtime-left:\033[0m {}\n", invalid_time ? "\033[2;31minvalid date\033[0m" : timeleft);
     if ((int)todos.size() - 1 == i) continue;
-    std::cout << " \033[2m    ────────────────────────────────────────────────────────────\033[0m\n";
+    std::print(" \033[2m    ────────────────────────────────────────────────────────────\033[0m\n");
   }
-  std::cout << " \033[2m  └─────────────────────────────────────────────────────────────\033[0m\n";
+  std::print(" \033[2m  └─────────────────────────────────────────────────────────────\033[0m\n");
 }
 
-void meow::todo::toggle(std::vector<std::string> args)
+void meow::todo::toggle(const std::vector<std::string> &args)
 {
   const int NUM_ARGS = args.size();
   if (NUM_ARGS != 4)
@@ -215,49 +251,50 @@ void meow::todo::toggle(std::vector<std::string> args)
     return;
   }
 
-  jsn::value data;
-  if (!meow::get_json(paths::data_path(), data))
-    return;
-  meow::ensure_array(data, "todos");
-  auto &todos = data["todos"].ref_array();
-
   std::string token = args[3];
-  bool changed = false;
   std::string todo_str = "";
   std::string status = "done";
-  try
+  bool updated = meow::update_data(meow::context::get().data_path(), [&](jsn::value &data, meow::mutation &m)
   {
-    int index = std::stoi(token);
-    if (index < 1 || index > static_cast<int>(todos.size()))
+    auto &todos = meow::ensure_array(data, "todos");
+    auto toggle_at = [&](std::size_t i)
     {
-      meow::handle_error("Index out of range");
-      return;
-    }
-    todo_str = todos[index - 1]["todo"].as_string();
-    auto& todo = todos[index - 1].ref_object();
-    todo["done"] = !todo["done"].as_boolean();
-    changed = true;
-    status = todo["done"].as_boolean() ? "done" : "not done";
-  }
-  catch (const std::invalid_argument &)
-  {
-    // Not a number: treat as todo string
-    auto it = std::ranges::find_if(todos, [&](const jsn::value &v) { return v["todo"].as_string() == token; });
-    todo_str = token;
-    if (it != todos.end())
+      const bool done = !todos[i]["done"].as_boolean();
+      m.set(std::format("todos[{}].done", i), done);
+      return done ? "done" : "not done";
+    };
+
+    bool changed = false;
+    try
     {
-      auto& todo = it->ref_object();
-      todo["done"] = !todo["done"].as_boolean();
+      int index = std::stoi(token);
+      if (index < 1 || index > static_cast<int>(todos.size()))
+      {
+        meow::handle_error("Index out of range");
+        return;
+      }
+      todo_str = todos[index - 1]["todo"].as_string();
+      status = toggle_at(index - 1);
       changed = true;
-      status = todo["done"].as_boolean() ? "done" : "not done";
     }
-  }
-  if (!changed)
-  {
-    meow::handle_error("No todo found with that index or description.");
+    catch (const std::invalid_argument &)
+    {
+      // Not a number: treat as todo string
+      auto it = std::ranges::find_if(todos, [&](const jsn::value &v) { return v["todo"].as_string() == token; });
+      todo_str = token;
+      if (it != todos.end())
+      {
+        status = toggle_at(it - todos.begin());
+        changed = true;
+      }
+    }
+
+    if (!changed)
+      meow::handle_error("No todo found with that index or description.");
+  });
+  if (!updated)
     return;
-  }
-  meow::write_data_or_error(paths::data_path().c_str(), data);
+
   std::println("Todo {} marked as {}!", todo_str, status);
   return void{};
 }
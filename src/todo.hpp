@@ -5,9 +5,9 @@ namespace meow
 {
   namespace todo
   {
-    void add(std::vector<std::string> args);
-    void remove(std::vector<std::string> args);
-    void list(std::vector<std::string> args);
-    void toggle(std::vector<std::string> args);
+    void add(const std::vector<std::string> &args);
+    void remove(const std::vector<std::string> &args);
+    void list(const std::vector<std::string> &args);
+    void toggle(const std::vector<std::string> &args);
   } // namespace todo
 }  // namespace meow
@@ -3,33 +3,36 @@
 #include <cstdio>
 #include <filesystem>
 #include <cstdlib>
-#include <fstream>
 #include <print>
-#include <iostream>
 #include <cstring>
+#include <cerrno>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace meow
 {
   std::optional<std::string> read_file(const std::string &filename)
   {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file)
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
       return std::nullopt;
 
-    file.seekg(0, std::ios::end);
-    std::size_t size = static_cast<std::size_t>(file.tellg());
-    file.seekg(0, std::ios::beg);
-
-    std::string content(size, '\0');
-    if (!file.read(content.data(), size))
-    {
+    auto content = read_fd(fd);
+    ::close(fd);
+    if (!content)
       std::println("Error reading file: {}", filename);
-      return std::nullopt;
-    }
-
     return content;
   }
 
+  static bool errors_recoverable = false;
+
+  recoverable_errors::recoverable_errors() : previous(std::exchange(errors_recoverable, true)) {}
+  recoverable_errors::~recoverable_errors() { errors_recoverable = previous; }
+
   void handle_error(const Error &e, bool _exit)
   {
     std::visit(
@@ -51,6 +54,8 @@ namespace meow
           }
         },
         e);
+    if (_exit && errors_recoverable)
+      throw command_error{};
     if (_exit)
       std::exit(EXIT_FAILURE);
     else
@@ -77,6 +82,80 @@ namespace meow
     return result;
   }
 
+  std::expected<std::vector<std::string>, std::string> split_args(std::string_view line)
+  {
+    std::vector<std::string> args;
+    std::string current;
+    bool in_arg = false;
+    char quote = '\0';
+
+    for (std::size_t i = 0; i < line.size(); ++i)
+    {
+      const char c = line[i];
+      if (quote == '\'')
+      {
+        if (c == '\'')
+          quote = '\0';
+        else
+          current += c;
+      }
+      else if (c == '\\')
+      {
+        if (++i == line.size())
+          return std::unexpected("Trailing backslash");
+        current += line[i];
+        in_arg = true;
+      }
+      else if (quote == '"')
+      {
+        if (c == '"')
+          quote = '\0';
+        else
+          current += c;
+      }
+      else if (c == '\'' || c == '"')
+      {
+        quote = c;
+        in_arg = true;
+      }
+      else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+      {
+        if (in_arg)
+          args.push_back(std::move(current));
+        current.clear();
+        in_arg = false;
+      }
+      else
+      {
+        current += c;
+        in_arg = true;
+      }
+    }
+
+    if (quote != '\0')
+      return std::unexpected(std::format("Unterminated {} quote", quote));
+    if (in_arg)
+      args.push_back(std::move(current));
+    return args;
+  }
+
+  std::optional<std::string> read_fd(int fd)
+  {
+    std::string content;
+    char buf[64 * 1024];
+    for (;;)
+    {
+      ssize_t n = ::read(fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return std::nullopt;
+      if (n == 0)
+        return content;
+      content.append(buf, static_cast<std::size_t>(n));
+    }
+  }
+
   bool is_path_absolute(std::string_view path)
   {
     if (path.front() == '/' || path.starts_with("~/") || path.starts_with("$HOME/") || path.starts_with("${HOME}/"))
@@ -85,56 +164,190 @@ namespace meow
       return false;
   }
 
-  std::expected<void, std::string> write_file(const std::string &filename, const std::string &content)
+  bool write_all(int fd, std::string_view content)
   {
-    std::string temp_filename = filename + ".tmp";
+    while (!content.empty())
+    {
+      ssize_t n = ::write(fd, content.data(), content.size());
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      content.remove_prefix(static_cast<std::size_t>(n));
+    }
+    return true;
+  }
 
-    std::ofstream file(temp_filename, std::ios::out);
-    if (!file)
-      return std::unexpected("Failed to open temporary file for writing");
+  // The mode a file created with open(2) would get. umask can only be read by setting it, so it is read once.
+  static mode_t creation_mode()
+  {
+    static const mode_t mode = []
+    {
+      const mode_t mask = ::umask(0);
+      ::umask(mask);
+      return static_cast<mode_t>(0666 & ~mask);
+    }();
+    return mode;
+  }
 
-    file.write(content.data(), content.size());
-    if (file.bad())
-      return std::unexpected("Failed to write to temporary file");
+  // Unique temporary next to `filename`, so it can be renamed over it. mkostemp creates it 0600; it gets the mode of
+  // the file it replaces, or the one a new file would get, so renaming it into place changes nothing about access.
+  static int open_temp(const std::string &filename, std::string &temp_filename)
+  {
+    temp_filename = filename + ".XXXXXX";
+    int fd = ::mkostemp(temp_filename.data(), O_CLOEXEC);
+    if (fd >= 0)
+    {
+      struct stat st{};
+      ::fchmod(fd, ::stat(filename.c_str(), &st) == 0 ? st.st_mode & 07777 : creation_mode());
+    }
+    return fd;
+  }
 
-    file.close();
+  // Makes a rename into the directory durable, best effort
+  static void sync_parent(const std::string &filename)
+  {
+    std::string dir = std::filesystem::path(filename).parent_path().string();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+      return;
+    ::fsync(fd);
+    ::close(fd);
+  }
+
+  // Flushes the written temporary to disk and moves it into place, the temporary is removed on failure
+  static std::expected<void, std::string> commit_temp(int fd, const std::string &temp_filename, const std::string &filename)
+  {
+    if (::fsync(fd) != 0)
+    {
+      int err = errno;
+      ::close(fd);
+      ::unlink(temp_filename.c_str());
+      return std::unexpected(std::format("Failed to sync temporary file: {}", std::strerror(err)));
+    }
+
+    if (::close(fd) != 0)
+    {
+      int err = errno;
+      ::unlink(temp_filename.c_str());
+      return std::unexpected(std::format("Failed to write to temporary file: {}", std::strerror(err)));
+    }
 
     if (std::rename(temp_filename.c_str(), filename.c_str()) != 0)
       return std::unexpected("Failed to rename temporary file to original. New config is in " + temp_filename);
 
+    sync_parent(filename);
     return {};
   }
 
-  bool get_json(std::string_view path, jsn::value &config)
+  std::expected<void, std::string> write_file(const std::string &filename, const std::string &content)
   {
-    std::filesystem::path _path = std::filesystem::absolute(path);
+    std::string temp_filename;
+    int fd = open_temp(filename, temp_filename);
+    if (fd < 0)
+      return std::unexpected("Failed to open temporary file for writing");
 
-    if (!std::filesystem::exists(_path))
+    if (!write_all(fd, content))
     {
-      std::error_code ec;
-      std::filesystem::create_directories(_path.parent_path(), ec);
-      if (ec)
-      {
-        std::println(stderr, "[ERROR]: Failed to create directories for {}: {}", _path.string(), ec.message());
-        return false;
-      }
+      int err = errno;
+      ::close(fd);
+      ::unlink(temp_filename.c_str());
+      return std::unexpected(std::format("Failed to write to temporary file: {}", std::strerror(err)));
+    }
 
-      std::ofstream file(_path);
-      if (!file)
+    return commit_temp(fd, temp_filename, filename);
+  }
+
+  std::expected<void, std::string> write_json_file(const std::string &filename, const jsn::value &data, int indent)
+  {
+    std::string temp_filename;
+    int fd = open_temp(filename, temp_filename);
+    if (fd < 0)
+      return std::unexpected("Failed to open temporary file for writing");
+
+    jsn::writer out(fd, 64 * 1024);
+    jsn::pretty_printer(data, indent).write_to(out);
+    if (!out.flush())
+    {
+      ::close(fd);
+      ::unlink(temp_filename.c_str());
+      return std::unexpected(std::format("Failed to write to temporary file: {}", std::strerror(out.last_error())));
+    }
+
+    return commit_temp(fd, temp_filename, filename);
+  }
+
+  // Creates the file (and its directories) holding an empty object
+  static bool create_empty_json(const std::filesystem::path &path)
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+    {
+      std::println(stderr, "[ERROR]: Failed to create directories for {}: {}", path.string(), ec.message());
+      return false;
+    }
+
+    // Linked into place rather than renamed: when another process got there first, its file is kept
+    std::string temp_filename;
+    int fd = open_temp(path.string(), temp_filename);
+    bool created = fd >= 0 && write_all(fd, "{\n}") && ::fsync(fd) == 0;
+    if (fd >= 0)
+      ::close(fd);
+    created = created && (::link(temp_filename.c_str(), path.c_str()) == 0 || errno == EEXIST);
+    if (fd >= 0)
+      ::unlink(temp_filename.c_str());
+
+    if (!created)
+      std::println(stderr, "[ERROR]: Failed to create file: {}", path.string());
+    return created;
+  }
+
+  // Reads a json file, creating it as an empty object first if it doesn't exist
+  static std::optional<std::string> read_or_create_json(std::string_view path, struct stat *st)
+  {
+    const std::string filename(path);
+
+    // The common case is a single open, the filesystem is only inspected when the file is missing
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT && create_empty_json(std::filesystem::absolute(filename)))
+      fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+    // Read through one descriptor so the stat describes exactly these contents, even if the file is replaced meanwhile
+    struct stat local_st{};
+    if (!st)
+      st = &local_st;
+
+    std::optional<std::string> json_str;
+    if (fd >= 0 && ::fstat(fd, st) == 0)
+    {
+      std::string content(static_cast<std::size_t>(st->st_size), '\0');
+      std::size_t done = 0;
+      while (done < content.size())
       {
-        std::println(stderr, "[ERROR]: Failed to create file: {}", _path.string());
-        return false;
+        ssize_t n = ::read(fd, content.data() + done, content.size() - done);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          break;
+        done += static_cast<std::size_t>(n);
       }
-
-      file << "{\n}";
+      if (done == content.size())
+        json_str = std::move(content);
     }
+    if (fd >= 0)
+      ::close(fd);
 
-    std::optional<std::string> json_str = meow::read_file(path.data());
     if (!json_str)
-    {
       std::println(stderr, "[ERROR]: Failed to read file: {}", path);
+    return json_str;
+  }
+
+  bool get_json(std::string_view path, jsn::value &config, struct stat *st)
+  {
+    std::optional<std::string> json_str = read_or_create_json(path, st);
+    if (!json_str)
       return false;
-    }
 
     std::expected<jsn::value, jsn::parse_error> config_ex = jsn::try_parse(json_str.value());
     if (!config_ex)
@@ -146,6 +359,22 @@ namespace meow
     return true;
   }
 
+  bool get_lazy_json(std::string_view path, jsn::lazy_document &doc, struct stat *st)
+  {
+    std::optional<std::string> json_str = read_or_create_json(path, st);
+    if (!json_str)
+      return false;
+
+    auto doc_ex = jsn::lazy_document::try_load(std::move(*json_str), std::string(path));
+    if (!doc_ex)
+    {
+      meow::handle_error(doc_ex.error());
+      return false;
+    }
+    doc = std::move(doc_ex.value());
+    return true;
+  }
+
   auto ensure_array(jsn::value &data, const std::string &key) -> std::vector<jsn::value> &
   {
     if (!data.exists(key))
@@ -162,9 +391,49 @@ namespace meow
     return val.ref_array();
   }
 
+  auto ensure_array(const jsn::lazy_document &data, const std::string &key) -> const std::vector<jsn::value> &
+  {
+    static const std::vector<jsn::value> empty;
+
+    const auto &val = data[key];
+    if (val.type() == jsn::Value_type::array)
+      return val.as_array();
+
+    if (val.type() != jsn::Value_type::null)
+      handle_error(std::format("config file is corrupted: '{}' must be an array", key));
+
+    return empty;
+  }
+
   void write_data_or_error(const char *path, const jsn::value &data)
   {
-    if (auto result = meow::write_file(path, jsn::pretty_print(data, 2)); !result)
+    if (auto result = meow::write_json_file(path, data, 2); !result)
       handle_error(std::format("[ERROR]: Failed to write config file: \n     {}", result.error()));
   }
+
+  file_lock::file_lock(const std::string &path)
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return;
+
+    while (::flock(fd, LOCK_EX) != 0)
+    {
+      if (errno == EINTR)
+        continue;
+      ::close(fd);
+      fd = -1;
+      return;
+    }
+  }
+
+  file_lock::~file_lock()
+  {
+    // Closing the descriptor releases the lock
+    if (fd >= 0)
+      ::close(fd);
+  }
 }  // namespace meow
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <exception>
 #include <optional>
 #include <string>
 #include <variant>
 #include <expected>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
 
 #include "./json.hpp"
+#include "./json_lazy.hpp"
 
 namespace meow
 {
@@ -15,15 +21,67 @@ namespace meow
 
   void handle_error(const Error &e, bool _exit = true);
 
+  // Thrown by handle_error, after printing, instead of exiting while a `recoverable_errors` guard is alive
+  struct command_error : std::exception
+  {
+    const char *what() const noexcept override { return "command failed"; }
+  };
+
+  // Lets the caller carry on after one command fails, used to run many commands in one process
+  class recoverable_errors
+  {
+  private:
+    bool previous;
+
+  public:
+    recoverable_errors();
+    ~recoverable_errors();
+    recoverable_errors(const recoverable_errors &) = delete;
+    recoverable_errors &operator=(const recoverable_errors &) = delete;
+  };
+
+  // Splits a command line into arguments: whitespace separated, with '...' and "..." quoting and \ escapes
+  std::expected<std::vector<std::string>, std::string> split_args(std::string_view line);
+
+  // Reads `fd` to the end
+  std::optional<std::string> read_fd(int fd);
+
   std::string expand_paths(std::string_view arg);
 
   bool is_path_absolute(std::string_view path);
 
+  bool write_all(int fd, std::string_view content);
+
+  // Written to a uniquely named temporary file, fsync'ed and renamed over `filename`, then the directory is fsync'ed.
+  // Concurrent writers never share a temporary and a crash leaves either the old or the new file.
   std::expected<void, std::string> write_file(const std::string &filename, const std::string &content);
 
-  bool get_json(std::string_view path, jsn::value &config);
+  // Serialises straight into the temporary file through a fixed-size buffer instead of building the whole text first
+  std::expected<void, std::string> write_json_file(const std::string &filename, const jsn::value &data, int indent = 2);
+
+  // `st`, when given, receives the stat of exactly the file that was read
+  bool get_json(std::string_view path, jsn::value &config, struct stat *st = nullptr);
+
+  // For read-only commands: members of the data file are only parsed when touched
+  bool get_lazy_json(std::string_view path, jsn::lazy_document &doc, struct stat *st = nullptr);
 
   auto ensure_array(jsn::value &data, const std::string &key) -> std::vector<jsn::value> &;
+  auto ensure_array(const jsn::lazy_document &data, const std::string &key) -> const std::vector<jsn::value> &;
 
   void write_data_or_error(const char *path, const jsn::value &data);
+
+  // Exclusive flock(2) on `path` (created, with its directory, if needed), released when the object goes away
+  class file_lock
+  {
+  private:
+    int fd = -1;
+
+  public:
+    explicit file_lock(const std::string &path);
+    ~file_lock();
+    file_lock(const file_lock &) = delete;
+    file_lock &operator=(const file_lock &) = delete;
+
+    [[nodiscard]] bool locked() const noexcept { return fd >= 0; }
+  };
 }  // namespace utls